@@ -0,0 +1,42 @@
+#ifndef ASENZT_H
+#define ASENZT_H
+
+#include <stddef.h>
+
+/* C interface of libasenzt, see asenzt.hpp */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct asenzt_options
+{
+    int text_output;     /* textual tables instead of binary object file */
+    int single_pass;     /* encode while reading */
+    int verify;          /* decode output and compare it with source */
+    unsigned int threads; /* workers for one source, 1 is serial */
+} asenzt_options;
+
+typedef struct asenzt_result asenzt_result;
+
+/* Default options, same as assembler without flags */
+void asenzt_default_options(asenzt_options *options);
+
+/* Assembles length bytes of source, options may be NULL. No files are read or written,
+ * .incbin is reported as an error. Result is freed with asenzt_free, NULL only when
+ * memory runs out */
+asenzt_result *asenzt_assemble(const char *source, size_t length, const asenzt_options *options);
+
+int asenzt_success(const asenzt_result *result);
+/* Object bytes, valid until result is freed */
+const unsigned char *asenzt_object(const asenzt_result *result, size_t *length);
+/* Zero terminated diagnostics, empty when there are none */
+const char *asenzt_diagnostics(const asenzt_result *result);
+void asenzt_free(asenzt_result *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
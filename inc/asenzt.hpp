@@ -0,0 +1,25 @@
+#include <string>
+#include <string_view>
+
+#include "assembler.hpp"
+
+#pragma once
+
+typedef struct assembly_result
+{
+    bool success;
+    std::string object;      // object file, or text tables with text_output
+    std::string diagnostics; // errors as the assembler prints them
+    Assembler_stats stats;
+
+    assembly_result()
+    {
+        this->success = false;
+    }
+} Assembly_result;
+
+/* ----- Library -----
+ * Assembles source held in memory and returns the object in memory. Nothing is read or
+ * written on disk, so .incbin is an error, and errors only go to diagnostics. A program
+ * can assemble many snippets in process, from any number of threads at once. */
+Assembly_result assemble(std::string_view source, Assembler_options options = Assembler_options());
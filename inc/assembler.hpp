@@ -3,66 +3,199 @@
 #include <string>
 #include <vector>
 #include <map>
-#include <regex>
+#include <unordered_map>
+#include <sstream>
+#include <string_view>
 
 #include "symbol_table.hpp"
 #include "section_table.hpp"
 #include "relocation_table.hpp"
+#include "statement.hpp"
+#include "lexer.hpp"
+#include "source_file.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+#include "instruction_table.hpp"
+#include "object_file.hpp"
+#include "expression.hpp"
 
 #pragma once
 
+typedef struct assembler_options
+{
+    bool text_output; // textual tables instead of binary object file
+    bool single_pass; // encode while reading, forward references are patched through fixups
+    unsigned int threads; // workers for one source, 1 is serial
+    bool verify;      // decode encoded instructions and compare them with statements
+
+    assembler_options()
+    {
+        this->text_output = false;
+        this->single_pass = false;
+        this->verify = false;
+        this->threads = 1;
+    }
+} Assembler_options;
+
+// Use of symbol that was not defined yet in single pass mode, chained per symbol
+typedef struct fixup
+{
+    unsigned int section;
+    unsigned int offset;     // payload in section, resolved in place or relocated once symbol is known
+    bool pc_relative;
+    long long addend;
+    unsigned int line;
+    unsigned int next;       // next fixup of same symbol, NO_FIXUP at the end of chain
+} Fixup;
+
+const unsigned int NO_FIXUP = ~0u;
+
+/* ----- Parallel first pass -----
+ * Source is split at line boundaries and every chunk is parsed on its own. Worker does not know
+ * in which section its chunk starts or where sections stand, so it records segments (runs of
+ * statements in one section, with sizes) and definitions with offsets inside their segment.
+ * Chunks are then merged in source order: a prefix sum per section gives every segment its
+ * base, and symbols are defined in the same order as in serial first pass. */
+
 typedef enum
 {
-    TOK_UNDEFINED = 0,
-    TOK_EOF,
-    TOK_SYMBOL,
-    TOK_INSTRUCTION,
-    TOK_DIRECTIVE,
-    TOK_REGISTER,
-    TOK_LABEL,
-    TOK_SECTION,
-} Token_type;
+    DEFINE_LABEL = 0,
+    DEFINE_EXTERN,
+    DEFINE_EQU,
+} Definition_kind;
+
+typedef struct chunk_definition
+{
+    Definition_kind kind;
+    std::string_view name;
+    unsigned int segment;
+    unsigned int offset;        // inside segment for labels
+    std::string_view expression; // for equ, evaluated when symbols before it are merged
+
+    chunk_definition(Definition_kind kind, std::string_view name, unsigned int segment, unsigned int offset)
+    {
+        this->kind = kind;
+        this->name = name;
+        this->segment = segment;
+        this->offset = offset;
+    }
+} Chunk_definition;
+
+typedef struct chunk_segment
+{
+    std::string_view section; // empty for first segment, which continues section of previous chunk
+    unsigned int size;
+
+    chunk_segment(std::string_view section)
+    {
+        this->section = section;
+        this->size = 0;
+    }
+} Chunk_segment;
+
+// Range of statements encoded by one worker of parallel second pass
+typedef struct encoder_chunk
+{
+    std::size_t begin;
+    std::size_t end;
+    Relocation_Table relocations; // numbered inside chunk, renumbered when chunks are merged
+    bool failed;
+    unsigned long long allocations; // made on worker thread
+} Encoder_chunk;
+
+typedef struct first_pass_chunk
+{
+    std::string_view text;
+    std::vector<Chunk_segment> segments;
+    std::vector<Chunk_definition> definitions;
+    std::vector<Statement> statements; // section is segment index, location counter is inside segment
+    Assembler_stats stats;
+    unsigned int lines;
+    bool ended;  // .end was found in chunk
+    bool failed; // chunk has diagnostics, whole source is assembled serially to report them in order
+    unsigned long long allocations; // made on worker thread
+} First_pass_chunk;
 
 class Assembler
 {
 public:
     Assembler();
-    Assembler(std::string SourceName, std::string DestName);
+    Assembler(std::string SourceName, std::string DestName, Assembler_options options = Assembler_options());
+    // Assembles text in memory, it has to outlive the assembler
+    Assembler(std::string_view source, Assembler_options options = Assembler_options());
 
     bool assemble();
+    std::string get_diagnostics();
+    const Assembler_stats &get_stats();
+    std::string &get_output(); // object or text tables of in memory assembly
 
 private:
-    void first_pass();
+    Assembler(First_pass_chunk *chunk);
+    Assembler(Assembler *parent);
+
+    void init_state();
+    void open_files(std::string SourceName, std::string DestName);
+    void write_output(const std::string &text);
+    void first_pass(std::string_view text);
+    void parallel_first_pass();
+    void first_pass_worker(First_pass_chunk &chunk);
+    bool merge_chunks(std::vector<First_pass_chunk> &chunks);
+    void parallel_second_pass();
+    void second_pass_worker(Encoder_chunk &chunk);
+    bool merge_encoder_chunks(std::vector<Encoder_chunk> &chunks);
     void second_pass();
-    void process_line();
-
-    bool first_pass_process_directive(std::string directive);
-    bool second_pass_process_directive(std::string directive);
-    bool first_pass_process_section(std::string section);
-    bool second_pass_process_section(std::string section);
-    bool first_pass_process_instruction(std::string instruction);
-    bool second_pass_process_instruction(std::string instruction);
-
-    bool process_word_directive(std::string token);
-    bool process_one_byte_instruction(std::string instruction);
-    bool process_two_byte_instruction(std::string instruction);
-    bool process_three_byte_instruction(std::string instruction);
-    bool process_jmp_instructions(std::string instruction);
-    bool process_ldr_str_instructions(std::string instruction);
-    bool process_push_pop_instructions(std::string instruction);
-
-    void increment_counter_for_three_or_more_bytes_instruction(std::string instruction);
-
-    std::string remove_comment_and_to_lower(std::string line);
-    std::string convert_char_to_hex(char str_num);
-    Token_type resolve_token_type(std::string token);
-    std::string convert_registers(std::string reg);
-    std::string resolve_registers();
-    std::string parse_literal(std::string literal);
-    bool is_literal(std::string literal);
-
-    std::ifstream input;
+    void allocate_sections();
+    void finish_single_pass();
+    void verify();
+    bool verify_statement(const Statement &stmt);
+
+    void add_statement(const Statement &stmt);
+    bool encode_statement(const Statement &stmt);
+    bool define_symbol(std::string_view name, unsigned int section, unsigned int offset);
+    bool define_label(std::string_view name);
+    bool define_extern(std::string_view name);
+    bool define_equ(std::string_view name, std::string_view expression);
+    bool evaluate_equ(std::string_view name, std::string_view expression, std::ostream &out);
+    void add_fixup(std::string_view name, bool pc_relative, long long addend);
+    void resolve_reference(const Symbol &smb, unsigned int smb_id, unsigned int section, unsigned int offset,
+                           bool pc_relative, long long addend);
+
+    bool first_pass_process_directive(Token_class directive, std::string_view name);
+    bool first_pass_process_section(Token_class section, std::string_view name);
+    bool first_pass_process_instruction(Token_class instruction, std::string_view name);
+    bool second_pass_process_directive(const Statement &stmt);
+    bool second_pass_process_instruction(const Statement &stmt);
+
+    bool process_word_directive(const Operand &op);
+    bool first_pass_process_data(Statement &stmt);
+    bool process_data_directive(const Statement &stmt);
+    bool check_byte_references(std::string_view text, Symbol_Table &symbols);
+    bool process_incbin_directive(const Statement &stmt);
+
+    bool next_token(std::string_view &token);
+    bool next_operand(std::string_view &operand);
+    std::string_view rest_of_line();
+    bool evaluate_constant(std::string_view text, Symbol_Table *symbols, long long &value);
+    bool parse_register_operand(Operand &op);
+    bool parse_jump_operand(Operand &op);
+    bool parse_data_operand(Operand &op);
+    bool parse_indirect_operand(std::string_view token, Operand &op);
+    bool emit_payload(const Operand &op);
+    void emit_byte(unsigned char byte);
+    void emit_word(unsigned int word);
+
+    bool parse_expression_operand(std::string_view text, Operand &op);
+
+    Source_File input;
     std::ofstream output;
+    bool in_memory;            // output goes to memory_output instead of file
+    std::string memory_output;
+    std::stringstream diagnostics;
+    Assembler_options options;
+    Assembler_stats stats;
+    unsigned long long allocations_at_start;
+    unsigned long long worker_allocations; // counted on threads of parallel passes
+    bool files_opened;
 
     Symbol_Table symbol_table;
     Section_Table section_table;
@@ -73,9 +206,17 @@ private:
     bool global_error;
     bool assembling;
     bool debug;
+    unsigned int line_number;
     unsigned int location_counter;
-    std::string current_section;
-    std::vector<std::string>::iterator token_iterator;
-    std::vector<std::string> tokenized_line;
-    std::map<int, std::vector<std::string>> lines;
+    unsigned int current_section;
+    Section *section_data; // current section in second pass
+    unsigned int emit_offset; // where next byte is written in current section
+    std::vector<std::string_view>::iterator token_iterator;
+    std::vector<std::string_view> tokenized_line;
+    std::string_view source_text; // text read by first pass, lines of tokens are inside it
+    std::vector<Statement> statements;
+    std::vector<Fixup> fixups;
+    First_pass_chunk *chunk; // set only in parallel first pass worker
+    Assembler *parent;       // set only in parallel second pass worker, owns symbols and sections
+    std::unordered_map<std::string_view, unsigned int, Name_hash, Name_equal> fixup_chains; // symbol name in source -> first fixup
 };
\ No newline at end of file
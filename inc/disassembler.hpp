@@ -0,0 +1,111 @@
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <vector>
+#include <cstddef>
+
+#include "instruction_table.hpp"
+#include "object_file.hpp"
+
+#pragma once
+
+// Instruction read back from encoded bytes
+typedef struct decoded_instruction
+{
+    Keyword_id id;
+    unsigned char size;
+    unsigned char d;       // first register nibble, fill for instructions without destination
+    unsigned char s;       // second register nibble, 0 for operands without register
+    Addressing_mode mode;  // ADDR_NONE for instructions without addressing mode
+    unsigned short payload;
+} Decoded_instruction;
+
+const unsigned char NO_INSTRUCTION = 0xFF;
+const unsigned short REGISTER_MASK = (1 << (REG_PSW + 1)) - 1;
+
+// Everything decode needs about one first byte, so an instruction is checked with masks
+// instead of branches on its shape
+typedef struct opcode_entry
+{
+    unsigned char id;          // NO_INSTRUCTION for bytes that are not an opcode
+    unsigned char size;        // without payload
+    unsigned short modes;      // allowed addressing modes, 0 without mode byte
+    unsigned short d_mask;     // allowed values of first register nibble
+    unsigned short s_mask;     // allowed values of second register nibble
+    unsigned char stack_id;    // push or pop that shares the opcode, NO_INSTRUCTION if none
+    unsigned char stack_update; // third byte of that push or pop
+} Opcode_entry;
+
+// Entry of every first byte, built from instruction table. push and pop share opcodes
+// with str and ldr, and are told apart by their third byte
+typedef struct opcode_table
+{
+    Opcode_entry entry[256];
+} Opcode_table;
+
+constexpr Opcode_table build_opcode_table()
+{
+    Opcode_table table = {};
+    for (unsigned int i = 0; i < 256; i++)
+    {
+        table.entry[i].id = NO_INSTRUCTION;
+        table.entry[i].stack_id = NO_INSTRUCTION;
+    }
+    for (std::size_t i = 0; i < INSTRUCTION_COUNT; i++)
+    {
+        const Instruction_info &info = instruction_table[i];
+        Opcode_entry &entry = table.entry[info.opcode];
+        if (info.shape == SHAPE_STACK)
+        {
+            entry.stack_id = info.id;
+            entry.stack_update = info.update_mode;
+            continue;
+        }
+        entry.id = info.id;
+        entry.size = info.size;
+        entry.modes = info.modes;
+        entry.d_mask = info.shape == SHAPE_JUMP ? 1 << info.fill : REGISTER_MASK;
+        entry.s_mask = info.shape == SHAPE_REG ? 1 << info.fill : REGISTER_MASK;
+    }
+    return table;
+}
+
+constexpr Opcode_table opcode_table = build_opcode_table();
+
+// Decodes what the assembler could have emitted, false for anything else or when bytes end
+bool decode_instruction(const unsigned char *bytes, std::size_t available, Decoded_instruction &ins);
+// Assembly syntax, payload is written as payload_text when it is not empty
+std::string format_instruction(const Decoded_instruction &ins, std::string_view payload_text = std::string_view());
+
+typedef struct disassembler_options
+{
+    bool stats; // print decode speed
+
+    disassembler_options()
+    {
+        this->stats = false;
+    }
+} Disassembler_options;
+
+/* ----- Disassembly -----
+ * Every section with bytes is decoded from its start. Labels are the symbols defined in
+ * the section, and payloads with a relocation name its symbol. Bytes that are not an
+ * instruction are written as .byte and decoding goes on with the next byte. */
+class Disassembler
+{
+public:
+    Disassembler(std::vector<std::string> inputs, std::string DestName, Disassembler_options options = Disassembler_options());
+
+    bool disassemble();
+    std::string get_diagnostics();
+
+private:
+    void disassemble_section(Object_File &file, unsigned int index, std::ostream &out);
+    std::string relocation_text(Object_File &file, const Relocation_record &rel, unsigned short payload);
+    void decode_all(Object_File &file, unsigned long long &bytes, unsigned long long &instructions);
+
+    std::vector<std::string> inputs;
+    std::string DestName;
+    Disassembler_options options;
+    std::stringstream diagnostics;
+};
@@ -0,0 +1,176 @@
+#include <string>
+#include <sstream>
+#include <vector>
+#include <chrono>
+
+#pragma once
+
+class Jit;
+
+const unsigned int MEMORY_SIZE = 0x10000;
+
+// Memory mapped registers
+const unsigned short MMIO_START = 0xFF00;
+const unsigned short TERM_OUT = 0xFF00;
+const unsigned short TERM_IN = 0xFF02;
+const unsigned short TIM_CFG = 0xFF10;
+
+// Entries of interrupt vector table at address 0
+typedef enum
+{
+    IVT_RESET = 0,
+    IVT_ERROR = 1,
+    IVT_TIMER = 2,
+    IVT_TERMINAL = 3,
+} Ivt_entry;
+
+typedef enum
+{
+    PSW_Z = 1 << 0,
+    PSW_O = 1 << 1,
+    PSW_C = 1 << 2,
+    PSW_N = 1 << 3,
+    PSW_TR = 1 << 13, // timer masked
+    PSW_TL = 1 << 14, // terminal masked
+    PSW_I = 1 << 15,  // all external interrupts masked
+} Psw_flag;
+
+// Register numbers as in instruction encoding, psw is written only through flags and iret
+typedef enum
+{
+    EMU_SP = 6,
+    EMU_PC = 7,
+    EMU_PSW = 8,
+    EMU_REGISTERS = 16, // nibble in encoding can name 16 registers, 9 to 15 are invalid
+} Emulator_register;
+
+// What decode found at an address, run() maps it to the label of its handler.
+// Direct forms have their operand resolved while decoding
+typedef enum
+{
+    H_DECODE = 0,
+    H_INVALID,
+    H_HALT,
+    H_INT,
+    H_IRET,
+    H_RET,
+    H_CALL_DIRECT,
+    H_JMP_DIRECT,
+    H_JEQ_DIRECT,
+    H_JNE_DIRECT,
+    H_JGT_DIRECT,
+    H_JUMP, // call and jumps through registers or memory
+    H_XCHG,
+    H_ADD,
+    H_SUB,
+    H_MUL,
+    H_DIV,
+    H_CMP,
+    H_NOT,
+    H_AND,
+    H_OR,
+    H_XOR,
+    H_TEST,
+    H_SHL,
+    H_SHR,
+    H_LDR_IMM,
+    H_LDR_REG,
+    H_LDR_IND, // register indirect, with or without displacement
+    H_LDR_MEM,
+    H_LDR,     // with register update
+    H_STR_REG,
+    H_STR_IND,
+    H_STR_MEM,
+    H_STR,
+    H_PUSH,
+    H_POP,
+    H_SLOW, // reads or writes pc, run by execute()
+    H_COUNT,
+} Handler_id;
+
+// One instruction decoded at its address. Handler is the label that executes it, decode
+// handler while address was not decoded yet or was written to since
+typedef struct decoded
+{
+    const void *handler;
+    unsigned short payload; // displacement, immediate, or target of direct jumps
+    unsigned char size;     // 0 for entries that are not decoded
+    unsigned char opcode;
+    unsigned char d;
+    unsigned char s;
+    unsigned char mode;
+    unsigned char update;
+    unsigned char id; // handler the instruction would have without pc, for H_SLOW
+} Decoded;
+
+typedef struct emulator_options
+{
+    bool stats; // print executed instructions and speed at halt
+    bool jit;   // translate hot blocks to host code
+
+    emulator_options()
+    {
+        this->stats = false;
+        this->jit = false;
+    }
+} Emulator_options;
+
+/* ----- Execution -----
+ * Every address has an entry in the decode cache, filled the first time it is executed.
+ * Handlers are labels in run() (direct threading with computed goto): an entry holds the
+ * address of its handler and every handler jumps straight to the next one. pc is a local of
+ * run() and is advanced before the handler runs, so pc relative operands are resolved while
+ * decoding. The few instructions that still read or write pc as a register go through
+ * execute(), with pc copied to r7 and back. Straight line handlers, loads and stores
+ * included, only count instructions. Only handlers that change pc (jumps, call, ret, int,
+ * iret and execute()) poll devices and interrupts, since every loop goes through one, once
+ * POLL_INTERVAL instructions have run since the last poll. With --jit every jump goes to the
+ * poll label, where hot targets run as translated blocks (see jit.hpp). */
+class Emulator
+{
+    friend class Jit;
+
+public:
+    Emulator(Emulator_options options = Emulator_options());
+    ~Emulator();
+
+    bool load(std::string name);
+    bool run();
+    std::string get_diagnostics();
+    std::string write_state();
+
+private:
+    static const unsigned int POLL_INTERVAL = 1 << 16;
+
+    Handler_id decode(unsigned short address, Decoded &entry);
+    unsigned short read_word(unsigned short address);
+    void write_word(unsigned short address, unsigned short value);
+    void push(unsigned short value);
+    unsigned short pop();
+    bool alu(unsigned int id, unsigned short &a, unsigned short b);
+    void transfer(const Decoded &entry);
+    bool execute(const Decoded &entry);
+    void interrupt(unsigned int entry);
+    void poll_devices();
+    void start_terminal();
+    void stop_terminal();
+
+    Emulator_options options;
+    std::stringstream diagnostics;
+    std::vector<unsigned char> memory; // one byte more, so a word at 0xFFFF can be read
+    std::vector<Decoded> cache;        // indexed by address
+    std::vector<unsigned char> code;   // address is part of a decoded instruction
+    const void *decode_handler;
+    Jit *jit; // NULL while only interpreting
+    unsigned short r[EMU_REGISTERS];
+    unsigned long long executed;
+
+    // Devices
+    unsigned short term_in;
+    unsigned short tim_cfg;
+    bool terminal_pending;
+    bool timer_pending;
+    bool input_open;
+    bool raw_terminal;
+    std::chrono::steady_clock::time_point next_tick;
+};
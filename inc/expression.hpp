@@ -0,0 +1,78 @@
+#include <string_view>
+#include <vector>
+#include <ostream>
+
+#include "symbol_table.hpp"
+
+#pragma once
+
+typedef enum
+{
+    TERM_LABEL = 0, // symbol defined in a section
+    TERM_EXTERN,    // symbol defined in other object
+    TERM_ABSOLUTE,  // .equ symbol
+    TERM_UNDEFINED, // not defined yet, or expression is parsed without symbols
+} Term_kind;
+
+// Symbol in an expression, added to (+1) or subtracted from (-1) the constant part
+typedef struct expression_term
+{
+    Term_kind kind;
+    std::string_view name;
+    unsigned int symbol;  // id in symbol table, only for defined symbols
+    unsigned int section;
+    long long value;      // offset in section for labels, value for absolute symbols
+    int coefficient;
+    bool folded;          // went through an operator other than + and -, so its value can not be added later
+} Expression_term;
+
+typedef struct expression
+{
+    long long constant;
+    std::vector<Expression_term> terms;
+
+    expression()
+    {
+        this->constant = 0;
+    }
+} Expression;
+
+// Recursive descent over + - * / << >> & | ^ ~ and parentheses, with C precedence.
+// Literals are folded right away, symbols stay as terms until the expression is reduced.
+// Without symbol table every symbol is undefined, which is enough to check syntax
+class Expression_Parser
+{
+public:
+    Expression_Parser(Symbol_Table *symbols, std::ostream &diagnostics);
+
+    bool parse(std::string_view text, Expression &result);
+
+private:
+    bool parse_or(Expression &result);
+    bool parse_xor(Expression &result);
+    bool parse_and(Expression &result);
+    bool parse_shift(Expression &result);
+    bool parse_additive(Expression &result);
+    bool parse_multiplicative(Expression &result);
+    bool parse_unary(Expression &result);
+    bool parse_primary(Expression &result);
+    bool parse_symbol(std::string_view name, Expression &result);
+    bool require_absolute(Expression &value, const char *operation);
+    bool accept(const char *operation);
+    void skip_spaces();
+
+    Symbol_Table *symbols;
+    std::ostream &diagnostics;
+    std::string_view text;
+    std::size_t position;
+};
+
+// Folds terms that cancel and absolute symbols into constant, leaving at most one term with
+// coefficient 1, which is the symbol to relocate against. Absolute symbols are kept as that
+// term for pc relative use, as their distance from pc is known only to linker
+bool reduce_expression(Expression &expr, bool pc_relative);
+
+bool fits_16_bits(long long value);
+
+// Whole text is one symbol name, so it needs no parsing
+bool is_symbol_name(std::string_view text);
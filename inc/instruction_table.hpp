@@ -0,0 +1,101 @@
+#include <cstddef>
+
+#include "lexer.hpp"
+#include "statement.hpp"
+
+#pragma once
+
+// Operands an instruction takes, which also fixes layout of its encoding:
+//   NONE      OC                      halt, iret, ret
+//   REG       OC  D|fill              int, not
+//   REG_REG   OC  D|S                 xchg, arithmetic, logic and shifts
+//   STACK     OC  D|sp  update|mode   push, pop
+//   JUMP      OC  fill|S  mode [payload]   call and jumps
+//   REG_DATA  OC  D|S     mode [payload]   ldr, str
+typedef enum
+{
+    SHAPE_NONE = 0,
+    SHAPE_REG,
+    SHAPE_REG_REG,
+    SHAPE_STACK,
+    SHAPE_JUMP,
+    SHAPE_REG_DATA,
+} Operand_shape;
+
+constexpr unsigned short mode_bit(Addressing_mode mode)
+{
+    return 1 << mode;
+}
+
+const unsigned short JUMP_MODES = mode_bit(ADDR_IMMEDIATE) | mode_bit(ADDR_REG_DIRECT) | mode_bit(ADDR_REG_INDIRECT) |
+                                  mode_bit(ADDR_REG_INDIRECT_DISP) | mode_bit(ADDR_MEMORY) | mode_bit(ADDR_REG_DIRECT_DISP);
+const unsigned short LOAD_MODES = mode_bit(ADDR_IMMEDIATE) | mode_bit(ADDR_REG_DIRECT) | mode_bit(ADDR_REG_INDIRECT) |
+                                  mode_bit(ADDR_REG_INDIRECT_DISP) | mode_bit(ADDR_MEMORY);
+// value can not be stored into immediate
+const unsigned short STORE_MODES = LOAD_MODES & ~mode_bit(ADDR_IMMEDIATE);
+
+typedef struct instruction_info
+{
+    Keyword_id id;
+    unsigned char opcode;      // first byte
+    Operand_shape shape;
+    unsigned short modes;      // addressing modes allowed for last operand, 0 if it has no addressing mode
+    unsigned char size;        // encoded size without payload
+    unsigned char fill;        // nibble in place of register instruction does not use
+    unsigned char update_mode; // third byte of push and pop
+} Instruction_info;
+
+const std::size_t INSTRUCTION_COUNT = KW_STR + 1;
+
+constexpr Instruction_info instruction_table[INSTRUCTION_COUNT] = {
+    {KW_HALT, 0x00, SHAPE_NONE, 0, 1, 0, 0},
+    {KW_INT, 0x10, SHAPE_REG, 0, 2, 0xF, 0},
+    {KW_IRET, 0x20, SHAPE_NONE, 0, 1, 0, 0},
+    {KW_CALL, 0x30, SHAPE_JUMP, JUMP_MODES, 3, 0xF, 0},
+    {KW_RET, 0x40, SHAPE_NONE, 0, 1, 0, 0},
+    {KW_JMP, 0x50, SHAPE_JUMP, JUMP_MODES, 3, 0xF, 0},
+    {KW_JEQ, 0x51, SHAPE_JUMP, JUMP_MODES, 3, 0xF, 0},
+    {KW_JNE, 0x52, SHAPE_JUMP, JUMP_MODES, 3, 0xF, 0},
+    {KW_JGT, 0x53, SHAPE_JUMP, JUMP_MODES, 3, 0xF, 0},
+    // push is str with pre-decrement, pop is ldr with post-increment
+    {KW_PUSH, 0xB0, SHAPE_STACK, 0, 3, 0, 0x11},
+    {KW_POP, 0xA0, SHAPE_STACK, 0, 3, 0, 0x41},
+    {KW_XCHG, 0x60, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_ADD, 0x70, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_SUB, 0x71, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_MUL, 0x72, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_DIV, 0x73, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_CMP, 0x74, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_NOT, 0x80, SHAPE_REG, 0, 2, 0, 0},
+    {KW_AND, 0x81, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_OR, 0x82, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_XOR, 0x83, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_TEST, 0x84, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_SHL, 0x90, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_SHR, 0x91, SHAPE_REG_REG, 0, 2, 0, 0},
+    {KW_LDR, 0xA0, SHAPE_REG_DATA, LOAD_MODES, 3, 0, 0},
+    {KW_STR, 0xB0, SHAPE_REG_DATA, STORE_MODES, 3, 0, 0},
+};
+
+constexpr bool check_instruction_table()
+{
+    for (std::size_t i = 0; i < INSTRUCTION_COUNT; i++)
+    {
+        if (instruction_table[i].id != i || keywords[i].type != TOK_INSTRUCTION)
+            return false;
+    }
+    return true;
+}
+
+static_assert(check_instruction_table(), "instruction table must follow keyword ids");
+
+// Immediate, displacement and memory operands carry two byte payload
+constexpr bool mode_has_payload(Addressing_mode mode)
+{
+    return mode == ADDR_IMMEDIATE || mode == ADDR_REG_INDIRECT_DISP || mode == ADDR_MEMORY || mode == ADDR_REG_DIRECT_DISP;
+}
+
+constexpr unsigned int instruction_size(Keyword_id id, Addressing_mode mode)
+{
+    return instruction_table[id].size + (instruction_table[id].modes != 0 && mode_has_payload(mode) ? 2 : 0);
+}
@@ -0,0 +1,93 @@
+#include <string>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <utility>
+
+#pragma once
+
+class Emulator;
+
+// Why translated code returned, kept in the bits above pc in the returned value
+typedef enum
+{
+    JIT_EXIT_JUMP = 0,   // reached a block that is not translated yet, or a return
+    JIT_EXIT_SIDE = 1,   // instruction at pc has to be run by the interpreter
+    JIT_EXIT_BUDGET = 2, // block at pc was not entered, budget is spent
+} Jit_exit;
+
+// Returned in rax and rdx by the trampoline
+typedef struct jit_result
+{
+    unsigned long long pc; // guest pc, and Jit_exit from bit 16
+    long long budget;      // instructions left
+} Jit_result;
+
+typedef Jit_result (*Jit_trampoline)(unsigned short *registers, unsigned char *memory, long long budget,
+                                     const void *block, const unsigned char *code);
+
+/* ----- Translation to x86-64 -----
+ * Basic blocks that start at hot jump targets are translated to host code. Guest r0-r6 and psw
+ * stay in host registers (rbx, rbp, r12-r15, r8, r9) for as long as execution stays in
+ * translated code; the trampoline loads them from the emulator and the epilogue stores them
+ * back. rsi points to guest memory, r10 to the flags of bytes that hold decoded code and r11
+ * counts the instruction budget down. Loads and stores of memory mapped registers, and stores
+ * into translated code, leave through a side exit before they change anything, so the
+ * interpreter runs that instruction. Exits to known addresses are patched into direct jumps
+ * when their target is translated. */
+class Jit
+{
+public:
+    Jit(Emulator &emulator);
+    ~Jit();
+
+    bool is_available();
+    // Translated block at pc, translates it when it gets hot, NULL if it is not translated
+    const void *block(unsigned short pc);
+    Jit_result enter(const void *block, long long budget);
+    // Guest code was written, every block is dropped
+    void flush();
+    std::string get_diagnostics();
+
+private:
+    static const std::size_t BUFFER_SIZE = 16 << 20;
+    static const unsigned int HOT_THRESHOLD = 16;
+    static const unsigned int MAX_BLOCK_INSTRUCTIONS = 64;
+    static const unsigned char NOT_TRANSLATABLE = 0xFF;
+
+    const void *translate(unsigned short pc);
+    void patch_jump(std::size_t site, std::size_t destination);
+    void protect(bool write);
+    void open_perf_map();
+
+    // Encoding
+    void emit8(unsigned char byte);
+    void emit16(unsigned short value);
+    void emit32(unsigned int value);
+    void rex(unsigned int reg, unsigned int base);
+    void op16_rr(unsigned char opcode, unsigned int dest, unsigned int source);
+    void mov32_rr(unsigned int dest, unsigned int source);
+    void movzx_rr(unsigned int dest, unsigned int source);
+    void mov16_ri(unsigned int dest, unsigned short value);
+    void movzx_load(unsigned int dest);
+    void mov16_store(unsigned int source);
+    std::size_t jcc(unsigned char condition);
+    std::size_t jmp();
+    void exit_to(unsigned int pc_and_kind);
+    void chain_exit(unsigned short target);
+    void check_address(bool store, unsigned int index);
+    void translate_flags(bool compare, unsigned int a, unsigned int b);
+
+    Emulator &emulator;
+    std::stringstream diagnostics;
+    unsigned char *buffer;
+    std::size_t used;
+    std::size_t epilogue;
+    std::size_t code_start; // first byte after trampoline and epilogue
+    std::vector<const void *> blocks;               // indexed by guest address
+    std::vector<unsigned char> heat;                // times address was a jump target while not translated
+    std::vector<std::vector<std::size_t>> waiting;  // exits to each address that is not translated yet
+    std::vector<std::pair<std::size_t, unsigned int>> side_exits; // of block being translated, jcc and instruction
+    std::FILE *perf_map;
+    bool writable; // buffer is mapped writable, otherwise executable
+};
@@ -0,0 +1,234 @@
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+#pragma once
+
+typedef enum
+{
+    TOK_UNDEFINED = 0,
+    TOK_EOF,
+    TOK_SYMBOL,
+    TOK_INSTRUCTION,
+    TOK_DIRECTIVE,
+    TOK_REGISTER,
+    TOK_LABEL,
+    TOK_SECTION,
+} Token_type;
+
+typedef enum
+{
+    // Instructions
+    KW_HALT = 0,
+    KW_INT,
+    KW_IRET,
+    KW_CALL,
+    KW_RET,
+    KW_JMP,
+    KW_JEQ,
+    KW_JNE,
+    KW_JGT,
+    KW_PUSH,
+    KW_POP,
+    KW_XCHG,
+    KW_ADD,
+    KW_SUB,
+    KW_MUL,
+    KW_DIV,
+    KW_CMP,
+    KW_NOT,
+    KW_AND,
+    KW_OR,
+    KW_XOR,
+    KW_TEST,
+    KW_SHL,
+    KW_SHR,
+    KW_LDR,
+    KW_STR,
+    // Directives
+    KW_GLOBAL,
+    KW_EXTERN,
+    KW_WORD,
+    KW_SKIP,
+    KW_EQU,
+    KW_END,
+    KW_BYTE,
+    KW_ASCII,
+    KW_ASCIZ,
+    KW_INCBIN,
+    // Sections
+    KW_TEXT,
+    KW_DATA,
+    KW_BSS,
+    KW_RODATA,
+    KW_SECTION,
+    // Registers
+    KW_R0,
+    KW_R1,
+    KW_R2,
+    KW_R3,
+    KW_R4,
+    KW_R5,
+    KW_R6,
+    KW_R7,
+    KW_SP,
+    KW_PC,
+    KW_PSW,
+    KW_COUNT,
+    KW_NONE = KW_COUNT,
+} Keyword_id;
+
+// Register numbers used in instruction encoding
+typedef enum
+{
+    REG_SP = 6,
+    REG_PC = 7,
+    REG_PSW = 8,
+} Special_register;
+
+typedef struct keyword
+{
+    const char *name;
+    std::size_t length;
+    Token_type type;
+    Keyword_id id;
+    unsigned char value; // register number, opcodes are in instruction table
+} Keyword;
+
+// Result of token classification, keyword id and value are set only for keywords
+typedef struct token_class
+{
+    Token_type type;
+    Keyword_id id;
+    unsigned char value;
+} Token_class;
+
+constexpr Keyword keywords[KW_COUNT] = {
+    {"halt", 4, TOK_INSTRUCTION, KW_HALT, 0},
+    {"int", 3, TOK_INSTRUCTION, KW_INT, 0},
+    {"iret", 4, TOK_INSTRUCTION, KW_IRET, 0},
+    {"call", 4, TOK_INSTRUCTION, KW_CALL, 0},
+    {"ret", 3, TOK_INSTRUCTION, KW_RET, 0},
+    {"jmp", 3, TOK_INSTRUCTION, KW_JMP, 0},
+    {"jeq", 3, TOK_INSTRUCTION, KW_JEQ, 0},
+    {"jne", 3, TOK_INSTRUCTION, KW_JNE, 0},
+    {"jgt", 3, TOK_INSTRUCTION, KW_JGT, 0},
+    {"push", 4, TOK_INSTRUCTION, KW_PUSH, 0},
+    {"pop", 3, TOK_INSTRUCTION, KW_POP, 0},
+    {"xchg", 4, TOK_INSTRUCTION, KW_XCHG, 0},
+    {"add", 3, TOK_INSTRUCTION, KW_ADD, 0},
+    {"sub", 3, TOK_INSTRUCTION, KW_SUB, 0},
+    {"mul", 3, TOK_INSTRUCTION, KW_MUL, 0},
+    {"div", 3, TOK_INSTRUCTION, KW_DIV, 0},
+    {"cmp", 3, TOK_INSTRUCTION, KW_CMP, 0},
+    {"not", 3, TOK_INSTRUCTION, KW_NOT, 0},
+    {"and", 3, TOK_INSTRUCTION, KW_AND, 0},
+    {"or", 2, TOK_INSTRUCTION, KW_OR, 0},
+    {"xor", 3, TOK_INSTRUCTION, KW_XOR, 0},
+    {"test", 4, TOK_INSTRUCTION, KW_TEST, 0},
+    {"shl", 3, TOK_INSTRUCTION, KW_SHL, 0},
+    {"shr", 3, TOK_INSTRUCTION, KW_SHR, 0},
+    {"ldr", 3, TOK_INSTRUCTION, KW_LDR, 0},
+    {"str", 3, TOK_INSTRUCTION, KW_STR, 0},
+    {".global", 7, TOK_DIRECTIVE, KW_GLOBAL, 0},
+    {".extern", 7, TOK_DIRECTIVE, KW_EXTERN, 0},
+    {".word", 5, TOK_DIRECTIVE, KW_WORD, 0},
+    {".skip", 5, TOK_DIRECTIVE, KW_SKIP, 0},
+    {".equ", 4, TOK_DIRECTIVE, KW_EQU, 0},
+    {".end", 4, TOK_DIRECTIVE, KW_END, 0},
+    {".byte", 5, TOK_DIRECTIVE, KW_BYTE, 0},
+    {".ascii", 6, TOK_DIRECTIVE, KW_ASCII, 0},
+    {".asciz", 6, TOK_DIRECTIVE, KW_ASCIZ, 0},
+    {".incbin", 7, TOK_DIRECTIVE, KW_INCBIN, 0},
+    {".text", 5, TOK_SECTION, KW_TEXT, 0},
+    {".data", 5, TOK_SECTION, KW_DATA, 0},
+    {".bss", 4, TOK_SECTION, KW_BSS, 0},
+    {".rodata", 7, TOK_SECTION, KW_RODATA, 0},
+    {".section", 8, TOK_SECTION, KW_SECTION, 0},
+    {"r0", 2, TOK_REGISTER, KW_R0, 0},
+    {"r1", 2, TOK_REGISTER, KW_R1, 1},
+    {"r2", 2, TOK_REGISTER, KW_R2, 2},
+    {"r3", 2, TOK_REGISTER, KW_R3, 3},
+    {"r4", 2, TOK_REGISTER, KW_R4, 4},
+    {"r5", 2, TOK_REGISTER, KW_R5, 5},
+    {"r6", 2, TOK_REGISTER, KW_R6, 6},
+    {"r7", 2, TOK_REGISTER, KW_R7, 7},
+    {"sp", 2, TOK_REGISTER, KW_SP, REG_SP},
+    {"pc", 2, TOK_REGISTER, KW_PC, REG_PC},
+    {"psw", 3, TOK_REGISTER, KW_PSW, REG_PSW},
+};
+
+constexpr unsigned char ascii_lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c - 'A' + 'a') : static_cast<unsigned char>(c);
+}
+
+// Perfect hash over keywords, parameters are chosen so that no two keywords share a slot.
+// Characters are folded to lower case, so source is never rewritten to match keywords
+const std::size_t KEYWORD_HASH_SIZE = 128;
+
+constexpr std::size_t keyword_hash(const char *s, std::size_t length)
+{
+    return (length + ascii_lower(s[0]) * 31 +
+            ascii_lower(s[length - 1]) * 14 +
+            ascii_lower(s[length / 2]) * 2) &
+           (KEYWORD_HASH_SIZE - 1);
+}
+
+typedef struct keyword_hash_table
+{
+    unsigned char slot[KEYWORD_HASH_SIZE]; // index into keywords, KW_NONE if empty
+    bool perfect;
+} Keyword_hash_table;
+
+constexpr Keyword_hash_table build_keyword_hash_table()
+{
+    Keyword_hash_table table = {{}, true};
+    for (std::size_t i = 0; i < KEYWORD_HASH_SIZE; i++)
+        table.slot[i] = KW_NONE;
+    for (std::size_t i = 0; i < KW_COUNT; i++)
+    {
+        std::size_t h = keyword_hash(keywords[i].name, keywords[i].length);
+        if (table.slot[h] != KW_NONE || keywords[i].id != i)
+            table.perfect = false;
+        table.slot[h] = static_cast<unsigned char>(i);
+    }
+    return table;
+}
+
+constexpr Keyword_hash_table keyword_hash_table = build_keyword_hash_table();
+static_assert(keyword_hash_table.perfect, "keyword hash has collisions");
+
+Token_class classify_token(std::string_view token);
+
+typedef enum
+{
+    LITERAL_NONE = 0,     // not a literal, token is symbol
+    LITERAL_OK,
+    LITERAL_INVALID,      // starts like literal but is malformed
+    LITERAL_OUT_OF_RANGE, // does not fit in 16 bits
+} Literal_status;
+
+// Decimal (optionally negative), 0x hex, 0b binary, 0o octal and 'c' character literals.
+// Value has to fit 16 bits, negative values are returned in two's complement
+Literal_status parse_literal(std::string_view token, unsigned int &value);
+
+// "text" with the escapes of character literals, length is number of decoded bytes.
+// Bytes are written to out unless it is NULL, so the same call sizes and encodes
+bool parse_string_literal(std::string_view token, unsigned char *out, std::size_t &length);
+
+bool equal_ignore_case(std::string_view a, std::string_view b);
+
+// Case insensitive hashing and comparison for containers keyed by names in source
+typedef struct name_hash
+{
+    std::size_t operator()(std::string_view name) const;
+} Name_hash;
+
+typedef struct name_equal
+{
+    bool operator()(std::string_view a, std::string_view b) const
+    {
+        return equal_ignore_case(a, b);
+    }
+} Name_equal;
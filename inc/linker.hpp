@@ -0,0 +1,106 @@
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <vector>
+#include <unordered_map>
+
+#include "object_file.hpp"
+#include "lexer.hpp"
+
+#pragma once
+
+// Memory mapped registers start here, sections have to end below them
+const unsigned int LINKER_MMIO_START = 0xFF00;
+
+// -place=section@address
+typedef struct placement
+{
+    std::string section;
+    unsigned int address;
+} Placement;
+
+typedef struct linker_options
+{
+    bool text_output; // hex dump instead of binary memory image
+    unsigned int threads; // workers for reading objects
+    std::vector<Placement> places;
+
+    linker_options()
+    {
+        this->text_output = false;
+        this->threads = 1;
+    }
+} Linker_options;
+
+// Section of one object inside an output section
+typedef struct section_part
+{
+    unsigned int object;
+    unsigned int section; // index in object
+    unsigned int offset;  // inside output section
+} Section_part;
+
+// Sections with the same name are concatenated in input order
+typedef struct output_section
+{
+    std::string_view name;
+    unsigned int address;
+    unsigned int size;
+    bool placed;
+    std::vector<Section_part> parts;
+
+    output_section(std::string_view name)
+    {
+        this->name = name;
+        this->address = 0;
+        this->size = 0;
+        this->placed = false;
+    }
+} Output_section;
+
+typedef struct global_symbol
+{
+    unsigned int object; // defining object, for messages
+    unsigned int value;  // final address, or constant of absolute symbol
+} Global_symbol;
+
+typedef struct input_object
+{
+    std::string name;
+    Object_File file;
+    bool opened;
+    std::vector<unsigned int> base; // address of every section of object
+} Input_object;
+
+/* ----- Linking -----
+ * Objects are mapped and validated in parallel, then used in place: names in the global symbol
+ * table and output sections point into their string tables. Output sections are placed by
+ * -place or after the highest placed one, in order of first appearance. Relocations are applied
+ * section by section in address order, and they are sorted by offset in every object, so the
+ * image is patched front to back. */
+class Linker
+{
+public:
+    Linker(std::vector<std::string> inputs, std::string DestName, Linker_options options = Linker_options());
+
+    bool link();
+    std::string get_diagnostics();
+
+private:
+    bool read_objects();
+    bool collect_sections();
+    bool place_sections();
+    bool collect_symbols();
+    bool resolve_symbol(Input_object &obj, unsigned int id, unsigned int &value);
+    bool build_image();
+    bool write_image();
+
+    std::string DestName;
+    Linker_options options;
+    std::stringstream diagnostics;
+    std::vector<Input_object> objects;
+    std::vector<Output_section> sections;
+    std::unordered_map<std::string_view, unsigned int, Name_hash, Name_equal> section_index;
+    std::unordered_map<std::string_view, Global_symbol, Name_hash, Name_equal> globals;
+    std::vector<unsigned char> image; // memory from address 0 to end of the last section
+};
@@ -0,0 +1,95 @@
+#include <string>
+#include <cstddef>
+
+#include "symbol_table.hpp"
+#include "section_table.hpp"
+#include "relocation_table.hpp"
+
+#pragma once
+
+// Binary object file, little endian:
+//   header | section headers | symbols | relocations | string table | section data
+// Every part starts at an offset aligned to OBJECT_ALIGNMENT, so a reader can mmap
+// the file and use the tables in place.
+const unsigned int OBJECT_MAGIC = 0x5A4E5341; // "ASNZ"
+const unsigned int OBJECT_VERSION = 4;
+const unsigned int OBJECT_ALIGNMENT = 8;
+
+typedef struct object_header
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int section_count;
+    unsigned int section_table_offset;
+    unsigned int symbol_count;
+    unsigned int symbol_table_offset;
+    unsigned int relocation_count;
+    unsigned int relocation_table_offset;
+    unsigned int string_table_size;
+    unsigned int string_table_offset;
+    unsigned int file_size;
+    unsigned int flags;
+} Object_header;
+
+typedef enum
+{
+    SECTION_UNDEFINED = 0,
+    SECTION_PROGBITS = 1,
+    SECTION_NOBITS = 2, // only zero fill, no bytes in file
+} Object_section_type;
+
+// Section index of symbols whose value is a constant, it has no section header
+const unsigned int SECTION_INDEX_ABSOLUTE = Section_Table::ABSOLUTE;
+
+typedef struct object_section
+{
+    unsigned int name; // offset in string table
+    unsigned int type;
+    unsigned int size;
+    unsigned int data_size;        // bytes stored in file, the rest up to size is zero
+    unsigned int data_offset;      // file offset of section bytes
+    unsigned int relocation_index; // first relocation of section, sorted by offset
+    unsigned int relocation_count;
+} Object_section;
+
+const unsigned int SYMBOL_GLOBAL = 1;
+
+typedef struct object_symbol
+{
+    unsigned int name;    // offset in string table
+    unsigned int value;   // offset inside section, constant for absolute symbols
+    unsigned int section; // section index, 0 is undefined, SECTION_INDEX_ABSOLUTE for constants
+    unsigned int flags;
+} Object_symbol;
+
+static_assert(sizeof(Object_header) == 48, "object header layout");
+static_assert(sizeof(Object_section) == 28, "section header layout");
+static_assert(sizeof(Object_symbol) == 16, "symbol layout");
+
+class Object_File
+{
+public:
+    Object_File();
+    ~Object_File();
+
+    static std::string write(Symbol_Table &symbol_table, Section_Table &section_table, Relocation_Table &relocation_table);
+
+    // Maps file into memory and validates it, returned pointers stay valid until close
+    bool open(std::string name);
+    bool open(const unsigned char *data, std::size_t length);
+    void close();
+
+    const Object_header *header();
+    const Object_section *section(unsigned int index);
+    const Object_symbol *symbol(unsigned int index);
+    const Relocation_record *relocations(unsigned int section);
+    const unsigned char *section_data(unsigned int section);
+    const char *string(unsigned int offset);
+
+private:
+    bool validate();
+
+    const unsigned char *data;
+    std::size_t length;
+    void *mapping;
+};
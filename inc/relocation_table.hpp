@@ -2,42 +2,48 @@
 #include <sstream>
 #include <vector>
 #include <algorithm>
-#include <regex>
 #include <iostream>
 #include <fstream>
 
+#include "section_table.hpp"
+
 #pragma once
 
+typedef enum
+{
+    R_386_16 = 0,
+    R_386_PC16 = 1,
+} Relocation_type;
+
+// Plain record, kept in one array per section like .rela.<section>
 typedef struct relocation_record
 {
-    unsigned int symbol_id;
-    std::string section;
     unsigned int offset;
-    std::string type;
-
-    relocation_record(
-        std::string section, unsigned int offset, unsigned int symbol_id, std::string type)
-    {
-        this->type = type;
-        this->symbol_id = symbol_id;
-        this->section = section;
-        this->offset = offset;
-    }
+    unsigned int symbol_id;
+    unsigned short section;
+    unsigned char type;
+    unsigned char padding;
 } Relocation_record;
 
+static_assert(sizeof(Relocation_record) == 12, "relocation record must stay 12 bytes");
+
 class Relocation_Table
 {
 public:
     Relocation_Table();
     ~Relocation_Table();
 
-    unsigned int insert_relocation_record(std::string section, unsigned int offset, unsigned int symbol_id, std::string type);
-    bool relocation_record_exists(unsigned int symbol_id);
+    // Returns index of the record inside relocations of its section
+    unsigned int insert_relocation_record(unsigned int section, unsigned int offset, unsigned int symbol_id, Relocation_type type);
+    const std::vector<Relocation_record> &get_section_relocations(unsigned int section);
+    unsigned int size();
+    static const char *type_name(unsigned char type);
+    void sort_by_offset();
 
-    std::string write_relocation_table();
-    std::string debug_write_relocation_table();
+    std::string write_relocation_table(Section_Table &section_table);
+    std::string debug_write_relocation_table(Section_Table &section_table);
 
 private:
-    unsigned int global_id = 0;
-    std::map<unsigned int, Relocation_record> table;
-};
\ No newline at end of file
+    unsigned int count = 0;
+    std::vector<std::vector<Relocation_record>> table; // indexed by section
+};
@@ -0,0 +1,7 @@
+#include <string>
+#include <vector>
+
+#pragma once
+
+// Appends one path per non-empty line of file, surrounding whitespace is dropped
+bool read_response_file(std::string name, std::vector<std::string> &paths);
@@ -0,0 +1,62 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#pragma once
+
+// Scanner processes source in blocks of 64 bytes, bit i of every mask describes byte i of the block
+const std::size_t SCAN_BLOCK_SIZE = 64;
+
+typedef struct block_masks
+{
+    std::uint64_t newline;   // '\n'
+    std::uint64_t comment;   // '#'
+    std::uint64_t delimiter; // ' ', '+', ',', '\t', '\r'
+    std::uint64_t quote;     // '\'', '"'
+} Block_masks;
+
+typedef enum
+{
+    SCAN_SCALAR = 0,
+    SCAN_SSE2,
+    SCAN_AVX2,
+} Scan_kernel;
+
+// Kernel is chosen once from cpu features, use_scan_kernel forces one (false if cpu does not support it)
+Scan_kernel active_scan_kernel();
+bool use_scan_kernel(Scan_kernel kernel);
+const char *scan_kernel_name(Scan_kernel kernel);
+
+// Copies length bytes from in to out with ASCII upper case letters folded to lower case
+void fold_lower(const char *in, std::size_t length, char *out);
+
+// Splits source into lines of tokens, tokens point into source.
+// Comments are dropped and line count matches std::getline over same text.
+// Quoted text is part of a token, so literals like ',' and '#' are not split or cut
+class Line_Scanner
+{
+public:
+    Line_Scanner(std::string_view text);
+
+    // Fills tokens of next line, returns false when there are no more lines
+    bool next_line(std::vector<std::string_view> &tokens);
+
+private:
+    bool load_block();
+    void mask_quotes(const char *data, std::uint64_t &comment, std::uint64_t &quoted);
+
+    std::string_view text;
+    std::size_t block;       // offset of current block
+    std::uint64_t starts;    // token starts not yet consumed
+    std::uint64_t ends;      // positions right after token ends not yet consumed
+    std::uint64_t newlines;  // line ends not yet consumed
+    std::uint64_t previous_token; // last byte of previous block is part of token
+    bool in_comment;         // comment continues from previous block
+    char in_quote;           // quote that opened text continuing from previous block, 0 outside quotes
+    bool escaped;            // last byte of previous block was a backslash inside quotes
+    bool loaded;             // at least one block was scanned
+    std::size_t token_start;
+    std::size_t line_start;
+};
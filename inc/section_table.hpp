@@ -2,7 +2,7 @@
 #include <sstream>
 #include <vector>
 #include <algorithm>
-#include <regex>
+#include <map>
 #include <iostream>
 #include <fstream>
 
@@ -13,14 +13,13 @@ typedef struct section
     std::string name;
     unsigned int size;
     unsigned int offset;
-    std::string bytecode;
+    std::vector<unsigned char> bytecode; // raw bytes up to last initialized byte, rest of size is zero fill
 
     section(std::string name, unsigned int size, unsigned int offset)
     {
         this->name = name;
         this->size = size;
         this->offset = offset;
-        this->bytecode = "";
     }
 } Section;
 
@@ -30,17 +29,25 @@ public:
     Section_Table();
     ~Section_Table();
 
-    bool insertSection(std::string name, unsigned int size, unsigned int offset);
-    bool updateSize(std::string section, unsigned int lc);
+    unsigned int insertSection(std::string name, unsigned int size, unsigned int offset);
+    bool updateSize(unsigned int section, unsigned int lc);
+    Section &get_section(unsigned int section);
+    unsigned int size();
+    void allocate_bytecode(const std::vector<unsigned int> &initialized);
 
-    unsigned int insert_into_absolute_section(std::string literal);
-    void add_zeros_to_section(std::string section, unsigned int number_of_bytes);
-    void append_bytecode(std::string section, std::string bytes);
+    const std::string &section_name(unsigned int section);
 
     std::string debug_write_section_table();
     std::string write_section_table();
     std::string to_lower(std::string s);
 
+    static constexpr unsigned int UND = 0;
+    // Not an entry of the table, symbols in it hold their value in offset (like SHN_ABS)
+    static constexpr unsigned int ABSOLUTE = 0xFFF1;
+
 private:
-    std::map<std::string, Section> table;
-};
\ No newline at end of file
+    std::string format_bytecode(const Section &sec);
+
+    std::vector<Section> sections;
+    std::map<std::string, unsigned int> table; // section name -> index in sections
+};
@@ -0,0 +1,32 @@
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+#pragma once
+
+// Read only view of assembler source, tokens and operands point into it
+class Source_File
+{
+public:
+    Source_File();
+    ~Source_File();
+
+    // Maps file into memory, falls back to reading it when it can not be mapped (pipes, devices)
+    bool open(std::string name);
+    // Uses caller's buffer, it has to outlive this object
+    bool open(const char *data, std::size_t length);
+    void close();
+
+    bool is_open();
+    std::string_view text();
+
+private:
+    Source_File(const Source_File &) = delete;
+    Source_File &operator=(const Source_File &) = delete;
+
+    const char *data;
+    std::size_t length;
+    void *mapping;
+    bool opened;
+    std::string buffer; // copy of the file when it is not mapped
+};
@@ -0,0 +1,71 @@
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lexer.hpp"
+
+#pragma once
+
+typedef enum
+{
+    STMT_INSTRUCTION = 0,
+    STMT_DIRECTIVE,
+    STMT_SECTION,
+} Statement_type;
+
+// Values match the low nibble of the third instruction byte
+typedef enum
+{
+    ADDR_IMMEDIATE = 0,
+    ADDR_REG_DIRECT = 1,
+    ADDR_REG_INDIRECT = 2,
+    ADDR_REG_INDIRECT_DISP = 3,
+    ADDR_MEMORY = 4,
+    ADDR_REG_DIRECT_DISP = 5,
+    ADDR_NONE = 0xF,
+} Addressing_mode;
+
+typedef struct operand
+{
+    Addressing_mode mode;
+    unsigned int reg;   // 0xF when operand does not use register
+    bool pc_relative;   // %symbol
+    bool is_literal;    // value holds literal, otherwise symbol name
+    unsigned int literal; // parsed value of literal
+    bool expression;      // value has operators, otherwise it is one symbol
+    std::string_view value; // literal or symbol in source text, empty if operand has no payload
+
+    operand()
+    {
+        this->mode = ADDR_NONE;
+        this->reg = 0xF;
+        this->pc_relative = false;
+        this->is_literal = false;
+        this->literal = 0;
+        this->expression = false;
+    }
+} Operand;
+
+// One record per statement, built once by the first pass and encoded by the second pass.
+// Operands point into source text, so statements live only while source is open
+typedef struct statement
+{
+    Statement_type type;
+    Keyword_id id;         // mnemonic, directive or section keyword
+    std::vector<Operand> operands;
+    unsigned int line;
+    unsigned int section; // index in section table
+    unsigned int location_counter;
+    unsigned int size;
+
+    statement(Statement_type type, Token_class keyword, unsigned int line,
+              unsigned int section, unsigned int location_counter)
+    {
+        this->type = type;
+        this->id = keyword.id;
+        this->line = line;
+        this->section = section;
+        this->location_counter = location_counter;
+        this->size = 0;
+    }
+} Statement;
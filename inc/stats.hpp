@@ -0,0 +1,74 @@
+#include <string>
+#include <chrono>
+
+#pragma once
+
+// Incremented by operator new in main, zero when assembler is used without it.
+// Counter is per thread, so every batch job sees only its own allocations. Workers of one
+// source count on their own threads and their parent adds those counts after the pool joins
+extern thread_local unsigned long long heap_allocations;
+
+typedef std::chrono::steady_clock Stats_clock;
+
+typedef enum
+{
+    PHASE_READ = 0,
+    PHASE_FIRST_PASS,
+    PHASE_SECOND_PASS,
+    PHASE_VERIFY,
+    PHASE_WRITE_SYMBOLS,
+    PHASE_WRITE_SECTIONS,
+    PHASE_WRITE_RELOCATIONS,
+    PHASE_WRITE_OBJECT,
+    PHASE_COUNT,
+} Stats_phase;
+
+typedef struct assembler_stats
+{
+    double phase_time[PHASE_COUNT]; // seconds
+    unsigned long long input_bytes;
+    unsigned long long lines;
+    unsigned long long tokens;
+    unsigned long long instructions[4]; // by size: 1, 2, 3 and 5 bytes
+    unsigned long long directives;
+    unsigned long long symbols;
+    unsigned long long relocations;
+    unsigned long long section_bytes;
+    unsigned long long heap_allocations;
+
+    assembler_stats()
+    {
+        for (unsigned int i = 0; i < PHASE_COUNT; i++)
+            this->phase_time[i] = 0;
+        for (unsigned int i = 0; i < 4; i++)
+            this->instructions[i] = 0;
+        this->input_bytes = 0;
+        this->lines = 0;
+        this->tokens = 0;
+        this->directives = 0;
+        this->symbols = 0;
+        this->relocations = 0;
+        this->section_bytes = 0;
+        this->heap_allocations = 0;
+    }
+
+    void add(const assembler_stats &other);
+    void count_instruction(unsigned int size);
+} Assembler_stats;
+
+// Measures one phase from construction to destruction
+class Phase_Timer
+{
+public:
+    Phase_Timer(Assembler_stats &stats, Stats_phase phase);
+    ~Phase_Timer();
+
+private:
+    Assembler_stats &stats;
+    Stats_phase phase;
+    Stats_clock::time_point start;
+};
+
+const char *phase_name(Stats_phase phase);
+std::string write_stats_text(std::string source, const Assembler_stats &stats);
+std::string write_stats_json(std::string source, const Assembler_stats &stats);
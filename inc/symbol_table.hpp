@@ -1,24 +1,27 @@
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <vector>
+#include <deque>
 #include <algorithm>
-#include <regex>
 #include <iostream>
 #include <fstream>
 
+#include "section_table.hpp"
+
 #pragma once
 
 typedef struct symbol
 {
-    std::string name;
+    std::string_view name; // interned in symbol table, lower case
     bool local;
     unsigned int id;
-    std::string section;
-    unsigned int offset;
+    unsigned int section; // index in section table, und for extern symbols, absolute for .equ
+    unsigned int offset;  // value of absolute symbol
     //unsigned int size;
 
-    symbol(std::string name, bool local, unsigned int id,
-           std::string section, unsigned int offset)
+    symbol(std::string_view name, bool local, unsigned int id,
+           unsigned int section, unsigned int offset)
     {
         this->name = name;
         this->local = local;
@@ -28,22 +31,36 @@ typedef struct symbol
     }
 } Symbol;
 
+// Result of one lookup, record is NULL when symbol does not exist
+typedef struct symbol_handle
+{
+    unsigned int id;
+    Symbol *record;
+} Symbol_handle;
+
 class Symbol_Table
 {
 public:
     Symbol_Table();
     ~Symbol_Table();
 
-    bool insertSymbol(std::string name, bool local, std::string section, unsigned int offset);
-    bool symbol_exists(std::string name);
-    void update_symbol_to_global(std::string name);
-    unsigned int get_symbol_id(std::string name);
-    unsigned int get_symbol_offset(std::string name);
+    bool insertSymbol(std::string_view name, bool local, unsigned int section, unsigned int offset);
+    Symbol_handle find_symbol(std::string_view name);
+    Symbol &get_symbol(unsigned int id);
+    unsigned int size();
 
-    std::string write_symbol_table();
-    std::string debug_write_symbol_table();
+    std::string write_symbol_table(Section_Table &section_table);
+    std::string debug_write_symbol_table(Section_Table &section_table);
 
 private:
+    static constexpr unsigned int EMPTY_SLOT = ~0u;
+
+    unsigned int find_slot(std::string_view name, std::size_t h);
+    void grow();
+    std::vector<unsigned int> sorted_by_name();
+
     unsigned int global_id = 0;
-    std::map<std::string, Symbol> table;
-};
\ No newline at end of file
+    std::deque<Symbol> symbols;      // dense by id, records never move
+    std::deque<std::string> names;   // interned names, never move
+    std::vector<unsigned int> slots; // open addressing with linear probing, holds ids
+};
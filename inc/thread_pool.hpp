@@ -0,0 +1,35 @@
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#pragma once
+
+// Work-stealing pool: every worker owns a queue and takes tasks from its front,
+// idle workers steal from the back of other queues
+class Thread_Pool
+{
+public:
+    Thread_Pool(unsigned int workers);
+    ~Thread_Pool();
+
+    // Runs all tasks and returns when every one of them has finished.
+    // Tasks are dealt to workers in the given order, so callers put the most expensive first.
+    void run(std::vector<std::function<void()>> &tasks);
+    unsigned int size();
+
+private:
+    typedef struct worker_queue
+    {
+        std::mutex lock;
+        std::deque<unsigned int> tasks;
+    } Worker_queue;
+
+    void work(unsigned int worker, std::vector<std::function<void()>> &tasks);
+    bool pop_task(unsigned int worker, unsigned int &task);
+    bool steal_task(unsigned int worker, unsigned int &task);
+
+    unsigned int workers;
+    std::vector<Worker_queue> queues;
+};
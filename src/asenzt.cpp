@@ -0,0 +1,83 @@
+#include <new>
+
+#include "../inc/asenzt.hpp"
+#include "../inc/asenzt.h"
+
+Assembly_result assemble(std::string_view source, Assembler_options options)
+{
+    Assembly_result result;
+    Assembler assembler(source, options);
+    try
+    {
+        result.success = assembler.assemble();
+    }
+    catch (std::exception &e)
+    {
+        result.success = false;
+        result.diagnostics = std::string("Standard exception: ") + e.what() + "\n";
+    }
+    result.diagnostics = assembler.get_diagnostics() + result.diagnostics;
+    result.object.swap(assembler.get_output());
+    result.stats = assembler.get_stats();
+    return result;
+}
+
+/* ----- C interface ----- */
+
+struct asenzt_result
+{
+    Assembly_result result;
+};
+
+void asenzt_default_options(asenzt_options *options)
+{
+    Assembler_options defaults;
+    options->text_output = defaults.text_output;
+    options->single_pass = defaults.single_pass;
+    options->verify = defaults.verify;
+    options->threads = defaults.threads;
+}
+
+asenzt_result *asenzt_assemble(const char *source, size_t length, const asenzt_options *options)
+{
+    // Exceptions may not cross into C
+    try
+    {
+        Assembler_options settings;
+        if (options != NULL)
+        {
+            settings.text_output = options->text_output != 0;
+            settings.single_pass = options->single_pass != 0;
+            settings.verify = options->verify != 0;
+            settings.threads = options->threads > 0 ? options->threads : 1;
+        }
+        asenzt_result *result = new asenzt_result;
+        result->result = assemble(std::string_view(source, length), settings);
+        return result;
+    }
+    catch (std::exception &)
+    {
+        return NULL;
+    }
+}
+
+int asenzt_success(const asenzt_result *result)
+{
+    return result->result.success;
+}
+
+const unsigned char *asenzt_object(const asenzt_result *result, size_t *length)
+{
+    *length = result->result.object.length();
+    return reinterpret_cast<const unsigned char *>(result->result.object.data());
+}
+
+const char *asenzt_diagnostics(const asenzt_result *result)
+{
+    return result->result.diagnostics.c_str();
+}
+
+void asenzt_free(asenzt_result *result)
+{
+    delete result;
+}
@@ -1,1597 +1,1773 @@
 #include <sstream>
 #include <algorithm>
-#include <exception>
+#include <cstring>
+#include <filesystem>
 
 #include "../inc/assembler.hpp"
+#include "../inc/thread_pool.hpp"
+#include "../inc/disassembler.hpp"
 
 Assembler::Assembler()
 {
+    init_state();
+    open_files("ulaz.s", "izlaz.o");
+}
 
-    this->input.open("ulaz.s", std::ios::out);
-    this->output.open("izlaz.o", std::ios::binary | std::ios::out | std::ios::trunc);
+Assembler::Assembler(std::string SourceName, std::string DestName, Assembler_options options)
+{
+    init_state();
+    this->options = options;
+    open_files(SourceName, DestName);
+}
 
-    if (!input.is_open())
-    {
-        std::cout << "Input file error" << std::endl;
-        exit(-1);
-    }
-    else if (!output.is_open())
-    {
-        std::cout << "Output file error" << std::endl;
-        exit(-1);
-    }
+Assembler::Assembler(std::string_view source, Assembler_options options)
+{
+    // Source stays with caller and output is kept for get_output, no files are opened
+    init_state();
+    this->options = options;
+    allocations_at_start = heap_allocations;
+    in_memory = true;
+    input.open(source.data(), source.length());
+    stats.input_bytes = source.length();
+    files_opened = true;
 }
 
-Assembler::Assembler(std::string SourceName, std::string DestName)
+Assembler::Assembler(First_pass_chunk *chunk)
 {
+    // Worker only runs first pass over chunk text, it has no files
+    init_state();
+    this->chunk = chunk;
+}
 
-    this->input.open(SourceName, std::ios::out);
-    this->output.open(DestName, std::ios::binary | std::ios::out | std::ios::trunc);
+Assembler::Assembler(Assembler *parent)
+{
+    // Worker only encodes statements of parent into its sections, relocations are kept here
+    init_state();
+    this->parent = parent;
+}
+
+// Every constructor starts from the same state, passes set what they need on top of it
+void Assembler::init_state()
+{
+    chunk = NULL;
+    parent = NULL;
+    files_opened = false;
+    in_memory = false;
+    allocations_at_start = 0;
+    worker_allocations = 0;
+    label_defined = false;
+    error_detected = false;
+    global_error = false;
+    assembling = false;
+    debug = false;
+    line_number = 0;
+    location_counter = 0;
+    current_section = Section_Table::UND;
+    section_data = NULL;
+    emit_offset = 0;
+}
 
-    if (!input.is_open())
+void Assembler::open_files(std::string SourceName, std::string DestName)
+{
+    // Errors are reported by assemble(), so many instances can run in one process
+    allocations_at_start = heap_allocations;
+    Phase_Timer timer(stats, PHASE_READ);
+    files_opened = false;
+    in_memory = false;
+    if (!input.open(SourceName))
     {
-        std::cout << "Input file error" << std::endl;
-        exit(-1);
+        diagnostics << "Input file error: " << SourceName << std::endl;
+        return;
     }
-    else if (!output.is_open())
+
+    this->output.open(DestName, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!output.is_open())
     {
-        std::cout << "Output file error" << std::endl;
-        exit(-1);
+        diagnostics << "Output file error: " << DestName << std::endl;
+        return;
     }
+    stats.input_bytes = input.text().length();
+    files_opened = true;
+}
+
+std::string Assembler::get_diagnostics()
+{
+    return diagnostics.str();
+}
+
+const Assembler_stats &Assembler::get_stats()
+{
+    return stats;
+}
+
+std::string &Assembler::get_output()
+{
+    return memory_output;
+}
+
+void Assembler::write_output(const std::string &text)
+{
+    if (in_memory)
+        memory_output += text;
+    else
+        output << text;
 }
 
 bool Assembler::assemble()
 {
     debug = false;
-    std::string buff;
-    std::stringstream lines;
+    global_error = false;
+    if (!files_opened)
+        return false;
+
     if (debug)
-        std::cout << " === FIRST PASS === " << std::endl;
+        diagnostics << " === FIRST PASS === " << std::endl;
 
-    first_pass();
+    {
+        Phase_Timer timer(stats, PHASE_FIRST_PASS);
+        if (options.threads > 1 && !options.single_pass)
+            parallel_first_pass();
+        else
+            first_pass(input.text());
+    }
 
     if (debug)
     {
-        symbol_table.debug_write_symbol_table();
+        symbol_table.debug_write_symbol_table(section_table);
         section_table.debug_write_section_table();
-        std::cout << " === SECOND PASS === " << std::endl;
+        diagnostics << " === SECOND PASS === " << std::endl;
+    }
+
+    {
+        Phase_Timer timer(stats, PHASE_SECOND_PASS);
+        if (options.single_pass)
+            finish_single_pass();
+        else if (options.threads > 1)
+            parallel_second_pass();
+        else
+            second_pass();
     }
 
-    second_pass();
+    // Encoding with errors leaves instructions unwritten, those are already reported
+    if (options.verify && !global_error)
+    {
+        Phase_Timer timer(stats, PHASE_VERIFY);
+        verify();
+    }
 
     if (debug)
     {
-        symbol_table.debug_write_symbol_table();
+        symbol_table.debug_write_symbol_table(section_table);
         section_table.debug_write_section_table();
-        relocation_table.debug_write_relocation_table();
+        relocation_table.debug_write_relocation_table(section_table);
     }
 
     // Write to file
-    output << symbol_table.write_symbol_table();
-    output << section_table.write_section_table();
-    output << relocation_table.write_relocation_table();
+    if (options.text_output)
+    {
+        std::string text;
+        {
+            Phase_Timer timer(stats, PHASE_WRITE_SYMBOLS);
+            text = symbol_table.write_symbol_table(section_table);
+        }
+        write_output(text);
+        {
+            Phase_Timer timer(stats, PHASE_WRITE_SECTIONS);
+            text = section_table.write_section_table();
+        }
+        write_output(text);
+        {
+            Phase_Timer timer(stats, PHASE_WRITE_RELOCATIONS);
+            text = relocation_table.write_relocation_table(section_table);
+        }
+        write_output(text);
+    }
+    else
+    {
+        Phase_Timer timer(stats, PHASE_WRITE_OBJECT);
+        write_output(Object_File::write(symbol_table, section_table, relocation_table));
+    }
 
     // Close files
     input.close();
     output.close();
 
+    stats.lines = line_number;
+    stats.symbols = symbol_table.size();
+    stats.relocations = relocation_table.size();
+    for (unsigned int i = 0; i < section_table.size(); i++)
+        stats.section_bytes += section_table.get_section(i).size;
+    stats.heap_allocations = heap_allocations - allocations_at_start + worker_allocations;
+
     if (global_error)
         return false;
     else
         return true;
 }
 
-void Assembler::first_pass()
+void Assembler::first_pass(std::string_view text)
 {
 
     // Initialize data
-    std::string line;
-    int num_line = 0;
+    Line_Scanner scanner(text);
+    source_text = text;
+    line_number = 0;
     location_counter = 0;
-    current_section = "UND"; // Setup undefined as first section
+    current_section = Section_Table::UND; // Setup undefined as first section
     assembling = true;
     error_detected = false;
     global_error = false;
+    statements.clear();
+    section_data = NULL;
+    if (chunk != NULL)
+        chunk->segments.push_back(chunk_segment(std::string_view()));
 
-    while (std::getline(input, line))
+    // Tokens are views into source, nothing is copied or lowercased
+    while (assembling && scanner.next_line(tokenized_line))
     {
-
-        /* ----- Reading and parsing input ----- */
-
-        line = remove_comment_and_to_lower(line);
-        //std::cout << "Line without comments: " << line << std::endl;
-        // Tokenizing
-        size_t start = line.find_first_not_of(" ,\t");
-        size_t end = start;
-        //std::cout << " Starting tokenization " << std::endl;
-
-        // Split line into tokens
-        while (start != std::string::npos)
-        {
-            end = line.find_first_of(" +,\t", start);
-            std::string pushin_string = line.substr(start, end - start);
-            //std::cout << "Adding string " << pushin_string << std::endl;
-            tokenized_line.push_back(pushin_string);
-            start = line.find_first_not_of(" +,\t", end);
-        }
-        //lines.insert(std::make_pair(num_line++, tokenized_line));
-        //std::cout << "Finished tokenization of line" << std::endl;
+        line_number++;
+        stats.tokens += tokenized_line.size();
 
         /* ----- Process every token ----- */
+        label_defined = false;
         for (token_iterator = tokenized_line.begin(); token_iterator != tokenized_line.end(); token_iterator++)
         {
-            if (error_detected)
-            {
-                error_detected = false;
-                global_error = true;
-                break; // jump out from this line, and get next
-            }
-
-            std::string token = *token_iterator;
+            std::string_view token = *token_iterator;
             if (debug)
-                std::cout << location_counter << ": processing token -> " << token << std::endl;
+                diagnostics << location_counter << ": processing token -> " << token << std::endl;
 
-            Token_type token_type = resolve_token_type(token);
+            Token_class token_class = classify_token(token);
 
-            // Reset label flag
-            if (token_type != TOK_LABEL)
-            {
-                label_defined = false;
-            }
-
-            switch (token_type)
+            switch (token_class.type)
             {
             case TOK_SECTION:
                 if (debug)
-                    std::cout << " Token is section " << std::endl;
-                if (!first_pass_process_section(token))
+                    diagnostics << " Token is section " << std::endl;
+                if (!first_pass_process_section(token_class, token))
                 {
-                    std::cout << "Error: processing section failed" << std::endl;
+                    diagnostics << "Error: processing section failed" << std::endl;
                     error_detected = true;
                 }
                 break;
             case TOK_LABEL:
                 if (label_defined)
                 {
-                    std::cout << "Error: Label already defined " << std::endl;
+                    diagnostics << "Error: Label already defined " << std::endl;
                     error_detected = true;
                     break;
                 }
                 if (debug)
-                    std::cout << "Token is label or section" << std::endl;
+                    diagnostics << "Token is label or section" << std::endl;
                 // Removing ':' from label name
-                token = token.substr(0, token.length() - 1);
+                token.remove_suffix(1);
                 // Insert into symbol table
-                if (!symbol_table.insertSymbol(token, true, current_section, location_counter))
+                if (!define_label(token))
                 {
                     error_detected = true;
-                    std::cout << "Error: Symbol already exists " << std::endl;
+                    diagnostics << "Error: Symbol already exists " << std::endl;
                     break;
                 }
                 label_defined = true;
                 break;
             case TOK_SYMBOL:
                 if (debug)
-                    std::cout << "Token is symbol " << std::endl;
-                if (!symbol_table.insertSymbol(token, true, current_section, location_counter))
+                    diagnostics << "Token is symbol " << std::endl;
+                if (!define_label(token))
                 {
-                    std::cout << "Error inserting symbol " << token << std::endl;
+                    diagnostics << "Error inserting symbol " << token << std::endl;
                     error_detected = true;
-                    break;
                 }
                 break;
             case TOK_DIRECTIVE:
                 if (debug)
-                    std::cout << "Token is directive" << std::endl;
-                if (!first_pass_process_directive(token))
+                    diagnostics << "Token is directive" << std::endl;
+                if (!first_pass_process_directive(token_class, token))
                 {
-                    std::cout << "Error processing directive " << token << std::endl;
+                    diagnostics << "Error processing directive " << token << std::endl;
                     error_detected = true;
-                    break;
                 }
                 break;
             case TOK_INSTRUCTION:
-                if (!first_pass_process_instruction(token))
+                if (!first_pass_process_instruction(token_class, token))
                 {
-                    std::cout << "Error processing instruction " << token << std::endl;
+                    diagnostics << "Error processing instruction " << token << std::endl;
                     error_detected = true;
-                    break;
                 }
                 if (debug)
-                    std::cout << "Instruction processed, lc is " << location_counter << std::endl;
+                    diagnostics << "Instruction processed, lc is " << location_counter << std::endl;
                 break;
             default:
                 if (debug)
-                    std::cout << "No action" << std::endl;
+                    diagnostics << "No action" << std::endl;
                 break;
             }
-            //std::cout << "Getting new token in line" << std::endl;
-            if (!assembling)
+
+            if (error_detected || !assembling)
             {
                 break;
             }
         }
 
-        // Reset variables
-        tokenized_line.clear();
+        if (error_detected)
+        {
+            diagnostics << "Line " << line_number << " skipped" << std::endl;
+            error_detected = false;
+            global_error = true;
+        }
+    }
+
+    // Close and update section
+    if (chunk != NULL)
+        chunk->segments[current_section].size = location_counter;
+    else
+        section_table.updateSize(current_section, location_counter);
+}
+
+void Assembler::parallel_first_pass()
+{
+    // Chunks end at line boundaries, several per worker so that stealing can even them out
+    const std::size_t MIN_CHUNK_SIZE = 64 * 1024;
+    std::string_view text = input.text();
+    std::size_t chunk_size = std::max(MIN_CHUNK_SIZE, text.length() / (options.threads * 4) + 1);
 
-        if (!assembling)
+    std::vector<First_pass_chunk> chunks;
+    std::size_t start = 0;
+    while (start < text.length())
+    {
+        std::size_t end = start + chunk_size;
+        if (end >= text.length())
         {
-            break;
+            end = text.length();
+        }
+        else
+        {
+            end = text.find('\n', end);
+            end = end == std::string_view::npos ? text.length() : end + 1;
         }
+        chunks.push_back(First_pass_chunk());
+        chunks.back().text = text.substr(start, end - start);
+        start = end;
     }
 
-    // Close and update section, reset variables
-    section_table.updateSize(current_section, location_counter);
-    location_counter = 0;
-    assembling = false;
-    current_section = "UND";
-    error_detected = false;
-    global_error = false;
+    if (chunks.size() < 2)
+    {
+        first_pass(text);
+        return;
+    }
+
+    std::vector<std::function<void()>> tasks;
+    for (unsigned int i = 0; i < chunks.size(); i++)
+    {
+        First_pass_chunk *current = &chunks[i];
+        tasks.push_back([this, current]()
+                        { first_pass_worker(*current); });
+    }
+    Thread_Pool pool(options.threads);
+    pool.run(tasks);
+    for (unsigned int i = 0; i < chunks.size(); i++)
+        worker_allocations += chunks[i].allocations;
+
+    Assembler_stats serial_stats = stats;
+    if (!merge_chunks(chunks))
+    {
+        // Errors are reported exactly as in serial mode
+        stats = serial_stats;
+        symbol_table = Symbol_Table();
+        section_table = Section_Table();
+        first_pass(text);
+    }
 }
 
-void Assembler::second_pass()
+void Assembler::first_pass_worker(First_pass_chunk &chunk)
 {
+    unsigned long long allocations = heap_allocations;
+    Assembler worker(&chunk);
+    worker.in_memory = in_memory;
+    worker.first_pass(chunk.text);
+    chunk.statements.swap(worker.statements);
+    chunk.stats = worker.stats;
+    chunk.lines = worker.line_number;
+    chunk.ended = !worker.assembling;
+    chunk.failed = worker.global_error || worker.diagnostics.tellp() > 0;
+    chunk.allocations = heap_allocations - allocations;
+}
 
-    // Initialize data
-    std::string line;
-    int num_line = 0;
+bool Assembler::merge_chunks(std::vector<First_pass_chunk> &chunks)
+{
+    // Parser state ends as serial first pass leaves it
+    line_number = 0;
+    current_section = Section_Table::UND;
     location_counter = 0;
-    current_section = "UND"; // Setup undefined as first section
     assembling = true;
     error_detected = false;
     global_error = false;
+    statements.clear();
 
-    // Move cursor to start of file
-    input.clear();
-    input.seekg(0, std::ios::beg);
+    std::size_t total = 0;
+    for (std::vector<First_pass_chunk>::iterator part = chunks.begin(); part != chunks.end(); ++part)
+        total += part->statements.size();
+    statements.reserve(total);
 
-    while (std::getline(input, line))
+    std::vector<unsigned int> segment_section, segment_base;
+    for (std::vector<First_pass_chunk>::iterator part = chunks.begin(); part != chunks.end(); ++part)
     {
-
-        /* ----- Reading and parsing input ----- */
-
-        line = remove_comment_and_to_lower(line);
-        //std::cout << "Line without comments: " << line << std::endl;
-        // Tokenizing
-        size_t start = line.find_first_not_of(" ,\t");
-        size_t end = start;
-        //std::cout << " Starting tokenization " << std::endl;
-
-        // Split line into tokens
-        tokenized_line.clear();
-        while (start != std::string::npos)
+        if (part->failed)
         {
-            end = line.find_first_of(" +,\t", start);
-            std::string pushin_string = line.substr(start, end - start);
-            //std::cout << "Adding string " << pushin_string << std::endl;
-            tokenized_line.push_back(pushin_string);
-            start = line.find_first_not_of(" +,\t", end);
+            global_error = true;
+            return false;
         }
-        lines.insert(std::make_pair(num_line++, tokenized_line));
-        //std::cout << "Finished tokenization of line" << std::endl;
 
-        /* ----- Process every token ----- */
-        for (token_iterator = tokenized_line.begin(); token_iterator != tokenized_line.end(); token_iterator++)
+        // Prefix sum per section, first segment continues section of previous chunk
+        segment_section.assign(part->segments.size(), current_section);
+        segment_base.assign(part->segments.size(), location_counter);
+        location_counter += part->segments[0].size;
+        for (unsigned int i = 1; i < part->segments.size(); i++)
         {
-            if (error_detected)
-            {
-                error_detected = false;
-                global_error = true;
-                break; // jump out from this line, and get next
-            }
-            std::string token = *token_iterator;
-
-            if (debug)
-                std::cout << location_counter << ": processing token (second pass) -> " << token << std::endl;
+            unsigned int index = section_table.insertSection(std::string(part->segments[i].section), 0, 0);
+            if (index == current_section)
+                return false;
+            section_table.updateSize(current_section, location_counter);
+            current_section = index;
+            location_counter = section_table.get_section(index).size;
+            segment_section[i] = current_section;
+            segment_base[i] = location_counter;
+            location_counter += part->segments[i].size;
+        }
 
-            Token_type token_type = resolve_token_type(token);
-            switch (token_type)
+        // Symbols in source order keep ids same as in serial first pass
+        for (std::vector<Chunk_definition>::iterator def = part->definitions.begin(); def != part->definitions.end(); ++def)
+        {
+            bool defined;
+            switch (def->kind)
             {
-            case TOK_SECTION:
-                if (debug)
-                    std::cout << " Token is section " << std::endl;
-                if (!second_pass_process_section(token))
-                {
-                    std::cout << "Error in second pass - processing section failed" << std::endl;
-                    error_detected = true;
-                }
-                break;
-            case TOK_DIRECTIVE:
-                if (debug)
-                    std::cout << "Token is directive" << std::endl;
-                if (!second_pass_process_directive(token))
-                {
-                    std::cout << "Error in second pass processing directive: " << token << std::endl;
-                    error_detected = true;
-                }
+            case DEFINE_LABEL:
+                defined = define_symbol(def->name, segment_section[def->segment], segment_base[def->segment] + def->offset);
                 break;
-            case TOK_INSTRUCTION:
-                if (debug)
-                    std::cout << "Token is instruction" << std::endl;
-                if (!second_pass_process_instruction(token))
-                {
-                    std::cout << "Error in second pass, processing instruction " << token << std::endl;
-                    error_detected = true;
-                }
+            case DEFINE_EXTERN:
+                defined = define_symbol(def->name, Section_Table::UND, 0);
                 break;
             default:
-                if (debug)
-                    std::cout << "No action" << std::endl;
+            {
+                // Failed expression is reported by serial first pass
+                std::stringstream ignored;
+                defined = evaluate_equ(def->name, def->expression, ignored);
                 break;
             }
+            }
+            if (!defined)
+                return false;
+        }
+
+        for (std::vector<Statement>::iterator stmt = part->statements.begin(); stmt != part->statements.end(); ++stmt)
+        {
+            stmt->location_counter += segment_base[stmt->section];
+            stmt->section = segment_section[stmt->section];
+            stmt->line += line_number;
+            statements.push_back(std::move(*stmt));
         }
-        if (!assembling)
+        line_number += part->lines;
+        stats.add(part->stats);
+
+        if (part->ended)
         {
+            assembling = false;
             break;
         }
     }
-}
 
-std::string Assembler::remove_comment_and_to_lower(std::string line)
-{
-    std::string line_without_comment = line.substr(0, line.find("#"));
-    std::transform(line_without_comment.begin(), line_without_comment.end(), line_without_comment.begin(), ::tolower);
-    return line_without_comment;
+    section_table.updateSize(current_section, location_counter);
+    return true;
 }
 
-Token_type Assembler::resolve_token_type(std::string value)
+void Assembler::allocate_sections()
 {
-    Token_type type_t = TOK_UNDEFINED;
-    std::regex label{"([a-zA-Z0-9_]*):"};
-    std::regex section{"(\\.)(text|data|bss|rodata|section)"};
-    std::regex directive{"\\.(global|extern|word|skip|equ|end)"};
-    std::regex instruction{"(halt|int|iret|call|ret|jmp|jeq|jne|jgt|push|pop|xchg|add|sub|mul|div|cmp|not|and|or|xor|test|shl|shr|ldr|str)?"};
-    std::regex symbol{("^([a-zA-Z_][a-zA-Z0-9]*)$")};
-    std::regex registers{("(r0|r1|r2|r3|r4|r5|r6|r7|sp|pc|psw)")};
-    std::regex end{"(\\.)(end)"};
-    if (std::regex_match(value, registers))
-        return Token_type::TOK_REGISTER;
-    if (std::regex_match(value, label))
-        return Token_type::TOK_LABEL;
-    if (std::regex_match(value, directive))
-        return Token_type::TOK_DIRECTIVE;
-    if (std::regex_match(value, section))
-        return Token_type::TOK_SECTION;
-    if (std::regex_match(value, instruction))
-        return Token_type::TOK_INSTRUCTION;
-    if (std::regex_match(value, symbol))
-        return Token_type::TOK_SYMBOL;
-    if (std::regex_match(value, end))
-        return Token_type::TOK_EOF;
-    return type_t;
+    // Buffer of every section ends with its last statement that has bytes, .skip adds none
+    std::vector<unsigned int> initialized(section_table.size(), 0);
+    for (std::vector<Statement>::const_iterator it = statements.begin(); it != statements.end(); ++it)
+    {
+        if (it->size > 0 && !(it->type == STMT_DIRECTIVE && it->id == KW_SKIP))
+            initialized[it->section] = std::max(initialized[it->section], it->location_counter + it->size);
+    }
+    section_table.allocate_bytecode(initialized);
 }
 
-bool Assembler::first_pass_process_directive(std::string directive)
+void Assembler::second_pass()
 {
-    if (directive.compare(".word") == 0)
-    {
-        if (debug)
-            std::cout << "Processing word directive in first pass" << std::endl;
-        // just increment location counter and skip symbols
-        //std::cout << ".word directive: Location counter value is " << location_counter << std::endl;
-        int num_of_symbols = 0;
-        while (++token_iterator != tokenized_line.end())
-            num_of_symbols++;
-        location_counter += 2 * num_of_symbols;
-        token_iterator--;
-        //std::cout << ".word directive: After execution of directive" << location_counter << std::endl;
-    }
-    else if (directive.compare(".skip") == 0) // done
-    {
-        if (debug)
-            std::cout << "Processing skip directive in first pass" << std::endl;
-        //std::cout << ".skip directive: Location counter value is " << location_counter << std::endl;
-        std::string next_token = *(++token_iterator);
+    // Only the statements collected in first pass are encoded, source is not read again
+    allocate_sections();
+    section_data = NULL;
 
-        int bytes_to_skip = 0;
-
-        try
-        {
-            bytes_to_skip = std::stoi(next_token);
-        }
-        catch (std::exception &e)
+    for (std::vector<Statement>::iterator it = statements.begin(); it != statements.end(); ++it)
+    {
+        if (section_data == NULL || it->section != current_section)
         {
-            std::cout << "Standard exception: " << e.what() << std::endl;
-            std::cout << "Execption in skip directive" << std::endl;
-            return false;
+            current_section = it->section;
+            section_data = &section_table.get_section(current_section);
         }
+        location_counter = it->location_counter;
+        emit_offset = it->location_counter;
 
-        //std::cout << bytes_to_skip << std::endl;
-        location_counter += bytes_to_skip;
-        //std::cout << ".skip directive: After execution of directive" << location_counter << std::endl;
+        if (!encode_statement(*it))
+            global_error = true;
     }
-    else if (directive.compare(".global") == 0) // done
+}
+
+void Assembler::parallel_second_pass()
+{
+    // Every statement already has its section and offset, so ranges of statements are independent
+    const std::size_t MIN_CHUNK_STATEMENTS = 4096;
+    std::size_t chunk_count = std::min<std::size_t>(options.threads * 4, statements.size() / MIN_CHUNK_STATEMENTS);
+    if (chunk_count < 2)
     {
-        // In first pass no processing
-        if (debug)
-            std::cout << "No processing for global directive in first pass" << std::endl;
-        while (++token_iterator != tokenized_line.end())
-            ;
-        token_iterator--;
+        second_pass();
+        return;
     }
-    else if (directive.compare(".extern") == 0) // done
-    {
-        try
-        {
-            if (debug)
-                std::cout << "Processing extern directive" << std::endl;
-            while (++token_iterator != tokenized_line.end())
-            {
-                std::string current_symbol = *token_iterator;
-                if (debug)
-                    std::cout << "Procssing extern symbol " << current_symbol << std::endl;
-                if (!symbol_table.insertSymbol(current_symbol, true, "extern", 0))
-                {
-                    std::cout << "Error inserting symbol with extern " << current_symbol << std::endl;
-                    return false;
-                }
-            }
-            token_iterator--;
-        }
 
-        catch (std::exception &e)
-        {
-            std::cout << "Standard exception in extern directive: " << e.what() << std::endl;
-            return false;
-        }
-    }
-    else if (directive.compare(".equ") == 0) // done
+    allocate_sections();
+    std::vector<Encoder_chunk> chunks(chunk_count);
+    std::vector<std::function<void()>> tasks;
+    for (std::size_t i = 0; i < chunk_count; i++)
     {
-        try
-        {
-
-            if (debug)
-                std::cout << "Processing equ directive in first pass" << std::endl;
-            std::string smb_name = *(++token_iterator);
-            std::string smb_literal = *(++token_iterator);
-            //std::cout << "Processing equ directive with symbols: " << smb_name << " & " << smb_literal << std::endl;
-            unsigned int abs_section_offest = section_table.insert_into_absolute_section(parse_literal(smb_literal));
-            if (!symbol_table.insertSymbol(smb_name, true, "absolute", abs_section_offest))
-            {
-                std::cout << "Error inserting symbol with equ directive: " << smb_name << std::endl;
-                return false;
-            }
-        }
-        catch (std::exception &e)
-        {
-            std::cout << "Standard exception: " << e.what() << std::endl;
-            return false;
-        }
+        chunks[i].begin = statements.size() * i / chunk_count;
+        chunks[i].end = statements.size() * (i + 1) / chunk_count;
+        chunks[i].failed = false;
+        chunks[i].allocations = 0;
+        Encoder_chunk *current = &chunks[i];
+        tasks.push_back([this, current]()
+                        { second_pass_worker(*current); });
     }
-    else if (directive.compare(".end") == 0)
+    Thread_Pool pool(options.threads);
+    pool.run(tasks);
+    for (std::size_t i = 0; i < chunk_count; i++)
+        worker_allocations += chunks[i].allocations;
+
+    if (!merge_encoder_chunks(chunks))
     {
-        if (debug)
-            std::cout << "Processing end directive" << std::endl;
-        // End of first pass
-        assembling = false;
-        return true;
+        // Errors are reported exactly as in serial mode, every byte is written again
+        relocation_table = Relocation_Table();
+        second_pass();
     }
-    //std::cout << "Exiting first pass process directive " << std::endl;
-    return true;
 }
 
-bool Assembler::second_pass_process_directive(std::string directive)
+void Assembler::second_pass_worker(Encoder_chunk &chunk)
 {
-    if (directive.compare(".word") == 0)
-    {
-        try
-        {
-            if (debug)
-                std::cout << "Processing word directive in second pass" << std::endl;
-            //std::cout << ".word directive: Location counter value is " << location_counter << std::endl;
-            int num_of_symbols = 0;
-
-            while (++token_iterator != tokenized_line.end())
-            {
-
-                if (!process_word_directive(*token_iterator))
-                {
-                    return false;
-                }
-
-                num_of_symbols++;
-            }
+    unsigned long long allocations = heap_allocations;
+    Assembler worker(this);
+    for (std::size_t i = chunk.begin; i < chunk.end; i++)
+    {
+        const Statement &stmt = statements[i];
+        // .global changes symbols, it is done after merge
+        if (stmt.type == STMT_SECTION || (stmt.type == STMT_DIRECTIVE && stmt.id == KW_GLOBAL))
+            continue;
+        worker.current_section = stmt.section;
+        worker.section_data = &section_table.get_section(stmt.section);
+        worker.location_counter = stmt.location_counter;
+        worker.emit_offset = stmt.location_counter;
+        if (!worker.encode_statement(stmt))
+            chunk.failed = true;
+    }
+    chunk.relocations = std::move(worker.relocation_table);
+    if (worker.diagnostics.tellp() > 0)
+        chunk.failed = true;
+    chunk.allocations = heap_allocations - allocations;
+}
 
-            //std::cout << "Outside while loop in second pass process directive word " << std::endl;
-            location_counter += 2 * num_of_symbols;
-            token_iterator--;
-            //std::cout << ".word directive: After execution of directive" << location_counter << std::endl;
-        }
-        catch (std::exception &e)
-        {
-            std::cout << "Standard exception in second pass of word directive: " << e.what() << std::endl;
+bool Assembler::merge_encoder_chunks(std::vector<Encoder_chunk> &chunks)
+{
+    for (std::vector<Encoder_chunk>::iterator part = chunks.begin(); part != chunks.end(); ++part)
+    {
+        if (part->failed)
             return false;
-        }
     }
-    else if (directive.compare(".skip") == 0)
+
+    // Records of every section are appended in source order, addends are already in place
+    for (std::vector<Encoder_chunk>::iterator part = chunks.begin(); part != chunks.end(); ++part)
     {
-        try
-        {
-            if (debug)
-                std::cout << "Processing skip directive in second pass" << std::endl;
-            //std::cout << ".skip directive: Location counter value is " << location_counter << std::endl;
-            int bytes_to_skip = std::stoi(*(++token_iterator));
-            //std::cout << bytes_to_skip << std::endl;
-            location_counter += bytes_to_skip;
-            section_table.add_zeros_to_section(current_section, bytes_to_skip);
-            //std::cout << ".skip directive: After execution of directive" << location_counter << std::endl;
-        }
-        catch (std::exception &e)
+        for (unsigned int section = 0; section < section_table.size(); section++)
         {
-            std::cout << "Standard exception in skip directive (second pass): " << e.what() << std::endl;
-            return false;
+            const std::vector<Relocation_record> &records = part->relocations.get_section_relocations(section);
+            for (std::vector<Relocation_record>::const_iterator it = records.begin(); it != records.end(); ++it)
+                relocation_table.insert_relocation_record(section, it->offset, it->symbol_id, (Relocation_type)it->type);
         }
     }
-    else if (directive.compare(".global") == 0)
-    {
-        try
-        {
-            if (debug)
-                std::cout << "Processing global directive in second pass" << std::endl;
-            // In second setup symbol that is global referencing to be global
 
-            // get every simbol after global directive
-            while (++token_iterator != tokenized_line.end())
-            {
-                std::string symbol = *token_iterator;
-                if (symbol_table.symbol_exists(symbol))
-                {
-                    symbol_table.update_symbol_to_global(symbol);
-                    //std::cout << "Symbol changed to global" << std::endl;
-                }
-                else
-                {
-                    std::cout << "Error, we have undefined symbol in global directive: " << symbol << std::endl;
-                    return false;
-                }
-            }
-            token_iterator--;
-        }
-        catch (std::exception &e)
+    // Undefined global symbol is reported by serial second pass, in its place among other errors
+    for (std::vector<Statement>::iterator it = statements.begin(); it != statements.end(); ++it)
+    {
+        if (it->type != STMT_DIRECTIVE || it->id != KW_GLOBAL)
+            continue;
+        for (std::vector<Operand>::const_iterator op = it->operands.begin(); op != it->operands.end(); ++op)
         {
-            std::cout << "Standard exception in global directive (second pass): " << e.what() << std::endl;
-            return false;
+            if (symbol_table.find_symbol(op->value).record == NULL)
+                return false;
         }
     }
-    else if (directive.compare(".extern") == 0) // done
-    {
-        if (debug)
-            std::cout << "Processing extern directive, no processing in second pass" << std::endl;
-    }
-    else if (directive.compare(".equ") == 0) // all processing done in first pass
+    for (std::vector<Statement>::iterator it = statements.begin(); it != statements.end(); ++it)
     {
-        if (debug)
-            std::cout << "No processing for equ directive in second pass" << std::endl;
-    }
-    else if (directive.compare(".end") == 0)
-    {
-        if (debug)
-            std::cout << "Processing end directive" << std::endl;
-        // End of first pass
-        assembling = false;
-        return true;
+        if (it->type == STMT_DIRECTIVE && it->id == KW_GLOBAL)
+            second_pass_process_directive(*it);
     }
     return true;
 }
 
-bool Assembler::process_word_directive(std::string token)
+bool Assembler::encode_statement(const Statement &stmt)
 {
     if (debug)
-        std::cout << "Proccesing word " << token << std::endl;
-    if (is_literal(token))
-    {
-        std::string parsed_literal = parse_literal(token);
-        parsed_literal.insert(2, " ");
-        section_table.append_bytecode(current_section, parsed_literal);
-    }
-    else // symbol
+        diagnostics << location_counter << ": processing statement (second pass) -> " << keywords[stmt.id].name << std::endl;
+
+    switch (stmt.type)
     {
-        //std::cout << "Proccesing as symbol " << token << std::endl;
-        std::string symbol = token;
-        if (symbol_table.symbol_exists(symbol))
+    case STMT_DIRECTIVE:
+        if (!second_pass_process_directive(stmt))
         {
-            //std::cout << "Found symbol " << std::endl;
-            unsigned int symbol_id = symbol_table.get_symbol_id(symbol);
-            //std::cout << "Symbol id is " << symbol_id << std::endl;
-            unsigned int reloc_id = relocation_table.insert_relocation_record(current_section, location_counter, symbol_id, "R_386_16");
-            //std::cout << "Reloc id is " << reloc_id << std::endl;
-            std::string reloc_id_in_hex = parse_literal(std::to_string(reloc_id));
-            //std::cout << "Parsed literal " << reloc_id_in_hex << std::endl;
-            reloc_id_in_hex.insert(2, " ");
-            section_table.append_bytecode(current_section, reloc_id_in_hex);
-            //std::cout << "After append bytecode " << std::endl;
+            diagnostics << "Error in second pass processing directive " << keywords[stmt.id].name << " at line " << stmt.line << std::endl;
+            return false;
         }
-        else
+        break;
+    case STMT_INSTRUCTION:
+        if (!second_pass_process_instruction(stmt))
         {
-            std::cout << "Symbol: " << symbol << " in word directive does not exist" << std::endl;
+            diagnostics << "Error in second pass, processing instruction " << keywords[stmt.id].name << " at line " << stmt.line << std::endl;
             return false;
         }
+        break;
+    default:
+        // Sections are already resolved in every statement
+        break;
     }
     return true;
 }
 
-bool Assembler::first_pass_process_section(std::string section)
+void Assembler::add_statement(const Statement &stmt)
 {
-    try
+    if (!options.single_pass)
     {
-        if (section.compare(".section") == 0)
-        {
-            // std::cout << "Getting section name" << std::endl;
-            section = *(++token_iterator);
-        }
-        else
-        {
-            // in case that we have .text or .rodata
-            section.erase(0, 1);
-        }
+        statements.push_back(stmt);
+        return;
+    }
 
-        //std::cout << "Section name is " << section << std::endl;
+    // Single pass encodes right away, only .global waits until all symbols are defined.
+    // Instructions are kept for --verify
+    if (stmt.type == STMT_SECTION)
+        return;
+    if (stmt.type == STMT_DIRECTIVE && stmt.id == KW_GLOBAL)
+    {
+        statements.push_back(stmt);
+        return;
+    }
+    if (stmt.type == STMT_INSTRUCTION && options.verify)
+        statements.push_back(stmt);
 
-        if (section.compare(current_section) == 0)
-        {
-            std::cout << "Error: section with same name again defined" << std::endl;
-            return false;
-        }
+    // Sections grow while they are written, so pointer is taken again for every statement
+    section_data = &section_table.get_section(stmt.section);
+    if (section_data->bytecode.size() < stmt.location_counter + stmt.size && !(stmt.type == STMT_DIRECTIVE && stmt.id == KW_SKIP))
+        section_data->bytecode.resize(stmt.location_counter + stmt.size, 0);
+    emit_offset = stmt.location_counter;
+    if (!encode_statement(stmt))
+        global_error = true;
+}
 
-        //std::cout << "Updatding size of previous section: " << current_section << std::endl;
-        section_table.updateSize(current_section, location_counter);
+bool Assembler::define_symbol(std::string_view name, unsigned int section, unsigned int offset)
+{
+    if (!symbol_table.insertSymbol(name, true, section, offset))
+        return false;
+    if (fixup_chains.empty())
+        return true;
 
-        current_section = section;
-        location_counter = 0;
-        // Adding section name to symbol table, not for now
-        // symbol_table.insertSymbol(section, true, current_section, location_counter);
-        section_table.insertSection(section, 0, 0); // check offest if it is used
+    // Patch every use that was encoded before definition
+    std::unordered_map<std::string_view, unsigned int, Name_hash, Name_equal>::iterator chain = fixup_chains.find(name);
+    if (chain == fixup_chains.end())
         return true;
-    }
-    catch (std::exception &e)
-    {
-        std::cout << "Standard exception: " << e.what() << std::endl;
-        std::cout << "Exception in processing section in first pass " << std::endl;
-        return false;
-    }
+
+    Symbol_handle smb = symbol_table.find_symbol(name);
+    for (unsigned int i = chain->second; i != NO_FIXUP; i = fixups[i].next)
+        resolve_reference(*smb.record, smb.id, fixups[i].section, fixups[i].offset, fixups[i].pc_relative, fixups[i].addend);
+    fixup_chains.erase(chain);
+    return true;
 }
 
-bool Assembler::second_pass_process_section(std::string section)
+bool Assembler::define_label(std::string_view name)
 {
-    if (section.compare(".section") == 0)
+    if (chunk != NULL)
     {
-        // get the section name
-        // std::cout << "Getting section name" << std::endl;
-        section = *(++token_iterator);
+        chunk->definitions.push_back(chunk_definition(DEFINE_LABEL, name, current_section, location_counter));
+        return true;
     }
-    else
+    return define_symbol(name, current_section, location_counter);
+}
+
+bool Assembler::define_extern(std::string_view name)
+{
+    if (chunk != NULL)
     {
-        section.erase(0, 1);
+        chunk->definitions.push_back(chunk_definition(DEFINE_EXTERN, name, current_section, 0));
+        return true;
     }
+    return define_symbol(name, Section_Table::UND, 0);
+}
 
-    //std::cout << "Section name is " << section << std::endl;
-
-    if (section.compare(current_section) == 0)
+bool Assembler::define_equ(std::string_view name, std::string_view expression)
+{
+    if (chunk != NULL)
     {
-        std::cout << "Error: section with same name again defined" << std::endl;
-        return false;
+        // Worker does not see symbols of earlier chunks, so expression is evaluated in merge
+        chunk->definitions.push_back(chunk_definition(DEFINE_EQU, name, current_section, 0));
+        chunk->definitions.back().expression = expression;
+        return true;
     }
-    //std::cout << "Updated size of " << current_section << std::endl;
-    current_section = section;
-    location_counter = 0;
-    return true;
+    return evaluate_equ(name, expression, diagnostics);
 }
 
-bool Assembler::first_pass_process_instruction(std::string instruction)
+bool Assembler::evaluate_equ(std::string_view name, std::string_view expression, std::ostream &out)
 {
-
-    std::regex one_byte_instruction{"(halt|iret|ret)?"};
-    std::regex two_bytes_instruction{"(int|xchg|add|sub|mul|div|cmp|not|and|or|xor|test|shl|shr)?"};
-    std::regex three_bytes_or_more_instruction{"(call|jmp|jeq|jne|jgt|push|pop|ldr|str)?"};
-    try
-    {
-        // Move location counter according to instruction size
-        if (std::regex_match(instruction, one_byte_instruction))
-            location_counter += 1;
-        if (std::regex_match(instruction, two_bytes_instruction))
-            location_counter += 2;
-        if (std::regex_match(instruction, three_bytes_or_more_instruction))
-        {
-            increment_counter_for_three_or_more_bytes_instruction(instruction);
-        }
-
-        // Go to end of line
-        auto token_iterator_in_front = token_iterator;
-        while (++token_iterator_in_front != tokenized_line.end())
+    // Only symbols defined before .equ can be used, so chains of .equ are evaluated in order
+    Expression expr;
+    Expression_Parser parser(&symbol_table, out);
+    if (!parser.parse(expression, expr))
+        return false;
+    for (std::vector<Expression_term>::iterator it = expr.terms.begin(); it != expr.terms.end(); ++it)
+    {
+        if (it->kind == TERM_UNDEFINED)
         {
-            if (debug)
-                std::cout << "Token inside instruction: " << *token_iterator_in_front << std::endl;
-            token_iterator++;
+            out << "Error: symbol " << it->name << " is not defined before equ directive" << std::endl;
+            return false;
         }
-
-        return true;
     }
-    catch (std::exception &e)
+    if (!reduce_expression(expr, false) || (!expr.terms.empty() && expr.terms[0].kind != TERM_LABEL))
     {
-        std::cout << "Standard exception: " << e.what() << std::endl;
-        std::cout << "Exception in processing section in first pass " << std::endl;
+        out << "Error: equ expression " << expression << " has to be constant or label plus constant" << std::endl;
         return false;
     }
-}
 
-bool Assembler::second_pass_process_instruction(std::string instruction)
-{
-
-    std::regex one_byte_instruction{"(halt|iret|ret)?"};
-    std::regex two_bytes_instruction{"(int|xchg|add|sub|mul|div|cmp|not|and|or|xor|test|shl|shr)?"};
-    std::regex three_bytes_instruction{"(call|jmp|jeq|jne|jgt|push|pop|ldr|str)?"};
-
-    if (debug)
-        std::cout << "Processing second pass instruction" << std::endl;
-
-    // Move location counter according to instruction size
-    if (std::regex_match(instruction, one_byte_instruction))
-    {
-        if (!process_one_byte_instruction(instruction))
-            return false;
-        location_counter += 1;
-    }
-    if (std::regex_match(instruction, two_bytes_instruction))
+    bool defined;
+    if (expr.terms.empty())
     {
-        if (!process_two_byte_instruction(instruction))
+        if (!fits_16_bits(expr.constant))
+        {
+            out << "Error: equ expression " << expression << " does not fit in 16 bits" << std::endl;
             return false;
-        location_counter += 2;
+        }
+        defined = define_symbol(name, Section_Table::ABSOLUTE, expr.constant & 0xFFFF);
     }
-    if (std::regex_match(instruction, three_bytes_instruction))
+    else
     {
-        //std::cout << "Three or more byte instruction detected" << std::endl;
-        if (!process_three_byte_instruction(instruction)) // location counter incremented inside
-            return false;
+        // Label plus constant is a label in the same section
+        defined = define_symbol(name, expr.terms[0].section, expr.terms[0].value + expr.constant);
     }
+    if (!defined)
+        out << "Error inserting symbol with equ directive: " << name << std::endl;
+    return defined;
+}
 
-    return true;
+void Assembler::add_fixup(std::string_view name, bool pc_relative, long long addend)
+{
+    Fixup fix;
+    fix.section = current_section;
+    fix.offset = emit_offset;
+    fix.pc_relative = pc_relative;
+    fix.addend = addend;
+    fix.line = line_number;
+    fix.next = NO_FIXUP;
+
+    // names point into source, which stays open until fixups are resolved
+    std::pair<std::unordered_map<std::string_view, unsigned int, Name_hash, Name_equal>::iterator, bool> chain =
+        fixup_chains.insert(std::make_pair(name, (unsigned int)fixups.size()));
+    if (!chain.second)
+    {
+        // new use goes to the head of chain
+        fix.next = chain.first->second;
+        chain.first->second = fixups.size();
+    }
+    fixups.push_back(fix);
 }
 
-bool Assembler::process_one_byte_instruction(std::string instruction)
+void Assembler::finish_single_pass()
 {
-    std::string instruction_bytes = "";
-    if (instruction.compare("halt") == 0)
+    // Global directives and symbols that were never defined are the only work left after reading
+    for (std::vector<Statement>::iterator it = statements.begin(); it != statements.end(); ++it)
     {
-        instruction_bytes = "00";
+        if (it->type != STMT_INSTRUCTION && !encode_statement(*it))
+            global_error = true;
     }
-    else if (instruction.compare("iret") == 0)
+
+    // Report uses in source order
+    std::vector<std::pair<unsigned int, const std::string_view *>> unresolved;
+    for (std::unordered_map<std::string_view, unsigned int, Name_hash, Name_equal>::iterator it = fixup_chains.begin(); it != fixup_chains.end(); ++it)
     {
-        instruction_bytes = "20";
+        for (unsigned int i = it->second; i != NO_FIXUP; i = fixups[i].next)
+            unresolved.push_back(std::make_pair(i, &it->first));
     }
-    else if (instruction.compare("ret") == 0)
+    std::sort(unresolved.begin(), unresolved.end());
+    for (unsigned int i = 0; i < unresolved.size(); i++)
     {
-        instruction_bytes = "40";
+        diagnostics << "Symbol " << *unresolved[i].second << " does not exist, used at line " << fixups[unresolved[i].first].line << std::endl;
+        global_error = true;
     }
-    else
+    fixup_chains.clear();
+    fixups.clear();
+}
+
+void Assembler::verify()
+{
+    for (std::vector<Statement>::iterator it = statements.begin(); it != statements.end(); ++it)
     {
-        std::cout << "Error in processing one byte instruction " << std::endl;
-        return false;
+        if (it->type == STMT_INSTRUCTION && !verify_statement(*it))
+            global_error = true;
     }
-    section_table.append_bytecode(current_section, instruction_bytes);
-    return true;
 }
 
-bool Assembler::process_two_byte_instruction(std::string instruction)
+// Instruction decoded from section bytes has to be the one in statement. Payloads of symbols
+// depend on relocations and are not compared
+bool Assembler::verify_statement(const Statement &stmt)
 {
-    std::string first_byte = "";
-    std::string second_byte = "";
-    std::string instruction_bytes = "";
-    if (instruction.compare("int") == 0)
-    {
-        first_byte = "10";
-
-        // get next token and check if it is register
-        std::string token = *(++token_iterator);
-        Token_type token_type = resolve_token_type(token);
-        if (token_type == TOK_REGISTER)
-            second_byte = convert_char_to_hex(token[1]) + "F";
-        else
-        {
-            std::cout << "Error in processing init instruction " << std::endl;
-            return false;
-        }
-        instruction_bytes = first_byte + " " + second_byte;
-    }
-    else if (instruction.compare("xchg") == 0)
-    {
-        first_byte = "60";
-        second_byte = resolve_registers();
-        instruction_bytes = first_byte + " " + second_byte;
-    }
-    else if (
-        instruction.compare("add") == 0 ||
-        instruction.compare("sub") == 0 ||
-        instruction.compare("mul") == 0 ||
-        instruction.compare("div") == 0 ||
-        instruction.compare("cmp") == 0)
-    {
-        first_byte = "7";
-        if (instruction.compare("add") == 0)
-            first_byte += "0";
-        else if (instruction.compare("sub") == 0)
-            first_byte += "1";
-        else if (instruction.compare("mul") == 0)
-            first_byte += "2";
-        else if (instruction.compare("div") == 0)
-            first_byte += "3";
-        else if (instruction.compare("cmp") == 0)
-            first_byte += "4";
-        else
+    const std::vector<unsigned char> &bytecode = section_table.get_section(stmt.section).bytecode;
+    Decoded_instruction ins;
+    if (stmt.location_counter >= bytecode.size() ||
+        !decode_instruction(bytecode.data() + stmt.location_counter, bytecode.size() - stmt.location_counter, ins))
+    {
+        diagnostics << "Verify error at line " << stmt.line << ": " << keywords[stmt.id].name << " does not decode" << std::endl;
+        return false;
+    }
+
+    const Instruction_info &info = instruction_table[stmt.id];
+    bool same = ins.id == stmt.id && ins.size == stmt.size;
+    if (same)
+    {
+        switch (info.shape)
         {
-            std::cout << "Unexpected behaviour in two byte instruction processing!" << std::endl;
-            return false;
-        }
-        second_byte = resolve_registers();
-        instruction_bytes = first_byte + " " + second_byte;
-    }
-    else if (
-        instruction.compare("not") == 0 ||
-        instruction.compare("and") == 0 ||
-        instruction.compare("or") == 0 ||
-        instruction.compare("xor") == 0 ||
-        instruction.compare("test") == 0)
-    {
-        first_byte = "8";
-        if (instruction.compare("not") == 0)
-            first_byte += "0";
-        else if (instruction.compare("and") == 0)
-            first_byte += "1";
-        else if (instruction.compare("or") == 0)
-            first_byte += "2";
-        else if (instruction.compare("xor") == 0)
-            first_byte += "3";
-        else if (instruction.compare("test") == 0)
-            first_byte += "4";
-        else
+        case SHAPE_NONE:
+            break;
+        case SHAPE_REG:
+        case SHAPE_STACK:
+            same = ins.d == stmt.operands[0].reg;
+            break;
+        case SHAPE_REG_REG:
+            same = ins.d == stmt.operands[0].reg && ins.s == stmt.operands[1].reg;
+            break;
+        default:
         {
-            std::cout << "Unexpected behaviour in two byte instruction processing!" << std::endl;
-            return false;
+            const Operand &op = stmt.operands.back();
+            same = ins.mode == op.mode && ins.s == (op.reg == 0xF ? 0 : op.reg);
+            if (info.shape == SHAPE_REG_DATA)
+                same = same && ins.d == stmt.operands[0].reg;
+            if (mode_has_payload(op.mode) && op.is_literal)
+                same = same && ins.payload == (op.literal & 0xFFFF);
+            break;
         }
-        if (instruction.compare("not") == 0)
-        {
-            std::string token = *(++token_iterator); // get next token
-            Token_type token_type = resolve_token_type(token);
-            if (token_type == TOK_REGISTER)
-                second_byte = convert_char_to_hex(token[1]) + "0"; // Setup 0 as default -> DDDD0000 where DDDD = destination and source register
         }
-        else
-            second_byte = resolve_registers();
-
-        instruction_bytes = first_byte + " " + second_byte;
     }
-    else if (
-        instruction.compare("shl") == 0 ||
-        instruction.compare("shr") == 0)
+    if (!same)
     {
-        first_byte = "9";
-        if (instruction.compare("shl") == 0)
-            first_byte += "0";
-        else if (instruction.compare("shr") == 0)
-            first_byte += "1";
-        else
-        {
-            std::cout << "Unexpected behaviour in two byte instruction processing!" << std::endl;
-            return false;
-        }
-        second_byte = resolve_registers();
-        instruction_bytes = first_byte + " " + second_byte;
+        diagnostics << "Verify error at line " << stmt.line << ": " << keywords[stmt.id].name << " decodes as " << format_instruction(ins) << std::endl;
+        return false;
     }
-    else
+    return true;
+}
+
+bool Assembler::next_token(std::string_view &token)
+{
+    if (token_iterator == tokenized_line.end() || token_iterator + 1 == tokenized_line.end())
     {
-        std::cout << "Unrecognized instructions in two byte instruction processing!" << std::endl;
+        diagnostics << "Error: missing operand" << std::endl;
         return false;
     }
-
-    section_table.append_bytecode(current_section, instruction_bytes);
+    token = *(++token_iterator);
     return true;
 }
 
-bool Assembler::process_three_byte_instruction(std::string instruction)
+std::string_view Assembler::rest_of_line()
 {
+    // Strings may hold delimiters and '#', so their directives read operands from source, not tokens
+    const char *start = token_iterator->data() + token_iterator->length();
+    const char *text_end = source_text.data() + source_text.length();
+    const char *end = static_cast<const char *>(std::memchr(start, '\n', text_end - start));
+    token_iterator = tokenized_line.end() - 1;
+    return std::string_view(start, (end != NULL ? end : text_end) - start);
+}
 
-    std::regex jmp_instrutions{"(call|jmp|jeq|jne|jgt)?"};
-    std::regex ldr_str_instructions{("(ldr|str)?")};
-    std::regex push_pop_instructions{("(push|pop)?")};
-
-    if (std::regex_match(instruction, jmp_instrutions))
-    {
-        if (!process_jmp_instructions(instruction))
-            return false;
-    }
-    else if (std::regex_match(instruction, ldr_str_instructions))
-    {
-        if (!process_ldr_str_instructions(instruction))
-            return false;
-    }
-    else if (std::regex_match(instruction, push_pop_instructions))
-    {
-        if (!process_push_pop_instructions(instruction))
-            return false;
-    }
-    else
+bool Assembler::evaluate_constant(std::string_view text, Symbol_Table *symbols, long long &value)
+{
+    Expression expr;
+    Expression_Parser parser(symbols, diagnostics);
+    if (!parser.parse(text, expr))
+        return false;
+    if (!reduce_expression(expr, false) || !expr.terms.empty())
     {
-        std::cout << "Unrecognized instruciton in three byte instruction processing!" << std::endl;
+        diagnostics << "Error: expected constant expression, got " << text << std::endl;
         return false;
     }
+    value = expr.constant;
     return true;
 }
 
-bool Assembler::process_jmp_instructions(std::string instruction)
+bool Assembler::next_operand(std::string_view &operand)
 {
-    std::string first_byte = "5";   // default value for all, except call
-    std::string second_byte = "F0"; // default value for all that are not using reg
-    std::string third_byte = "";
-    std::string fourth_byte = "";
-    std::string fifth_byte = "";
-    std::string instruction_bytes = "";
-
-    location_counter += 3; // for first three bytes
-
-    // set up opcode byte
-    if (instruction.compare("call") == 0)
-        first_byte = "30";
-    else if (instruction.compare("jmp") == 0)
-        first_byte += "0";
-    else if (instruction.compare("jeq") == 0)
-        first_byte += "1";
-    else if (instruction.compare("jne") == 0)
-        first_byte += "2";
-    else if (instruction.compare("jgt") == 0)
-        first_byte += "3";
-    else
-    {
-        std::cout << "Unrecognized jump instruction" << std::endl;
+    std::string_view first;
+    if (!next_token(first))
         return false;
+
+    // Scanner splits expressions at spaces and '+', operand ends where a comma separates tokens
+    const char *end = first.data() + first.length();
+    while (token_iterator + 1 != tokenized_line.end())
+    {
+        std::string_view next = *(token_iterator + 1);
+        if (std::string_view(end, next.data() - end).find(',') != std::string_view::npos)
+            break;
+        ++token_iterator;
+        end = next.data() + next.length();
     }
+    operand = std::string_view(first.data(), end - first.data());
+    return true;
+}
 
-    // get next token
-    std::string next_token = *(++token_iterator);
-    //std::cout << "Got next token in jmp " << next_token << std::endl; //<< " and value at 0 " << next_token.at(0) << std::endl;
+bool Assembler::first_pass_process_directive(Token_class directive, std::string_view name)
+{
+    Statement stmt = statement(STMT_DIRECTIVE, directive, line_number, current_section, location_counter);
+    stats.directives++;
 
-    if (next_token.at(0) == '%') // %symbol
+    switch (directive.id)
     {
-        //std::cout << "Proccessing jmp percent symbol" << std::endl;
-        // parse to remove %
-        next_token.erase(0, 1);
-        //std::cout << "Substring passed" << std::endl;
-        std::string symbol = next_token;
-        second_byte = "F7";
-        third_byte = "05";
-        if (symbol_table.symbol_exists(symbol))
+    case KW_WORD:
+    {
+        if (debug)
+            diagnostics << "Processing word directive in first pass" << std::endl;
+        // save every expression for second pass
+        while (token_iterator + 1 != tokenized_line.end())
         {
-            unsigned int symbol_id = symbol_table.get_symbol_id(symbol);
-            unsigned int reloc_id = relocation_table.insert_relocation_record(current_section, location_counter, symbol_id, "R_386_PC16");
-            std::string reloc_id_in_hex = parse_literal(std::to_string(reloc_id));
-            fourth_byte += reloc_id_in_hex[0];
-            fourth_byte += reloc_id_in_hex[1];
-            fifth_byte += reloc_id_in_hex[2];
-            fifth_byte += reloc_id_in_hex[3];
+            Operand op;
+            std::string_view expression;
+            op.mode = ADDR_IMMEDIATE;
+            if (!next_operand(expression) || !parse_expression_operand(expression, op))
+                return false;
+            stmt.operands.push_back(op);
         }
-        else
+        stmt.size = 2 * stmt.operands.size();
+        break;
+    }
+    case KW_SKIP:
+    {
+        if (debug)
+            diagnostics << "Processing skip directive in first pass" << std::endl;
+        // Size has to be known now, so only symbols defined before .skip can be used
+        Operand op;
+        long long size;
+        if (!next_operand(op.value) || !evaluate_constant(op.value, chunk != NULL ? NULL : &symbol_table, size))
+            return false;
+        if (size < 0 || size > 0xFFFF)
         {
-            std::cout << "Symbol " << symbol << " does not exist" << std::endl;
+            diagnostics << "Error: skip size " << op.value << " out of range" << std::endl;
             return false;
         }
-        instruction_bytes = first_byte + " " + second_byte + " " + third_byte + " " + fourth_byte + " " + fifth_byte;
-        location_counter += 2; // for fourth and fifth byte
+
+        op.mode = ADDR_IMMEDIATE;
+        op.is_literal = true;
+        op.literal = size;
+        stmt.operands.push_back(op);
+        stmt.size = op.literal;
+        break;
     }
-    else if (next_token.at(0) == '*') // *literal, *symbol, *reg, *[reg], *[reg + literal], *[reg + symbol]
+    case KW_GLOBAL:
     {
+        // Symbols are updated to global in second pass, when all of them are defined
         if (debug)
-            std::cout << "Proccessing jmp *literal, *symbol, *reg, *[reg], *[reg + literal], *[reg + symbol]" << std::endl;
-        // parse to remove *
-        next_token.erase(0, 1);
-        //std::cout << "After ereasing" << next_token << std::endl;
-        if (next_token.at(0) == '[') // *[reg], *[reg + literal], *[reg + symbol]
+            diagnostics << "Saving global directive for second pass" << std::endl;
+        while (token_iterator + 1 != tokenized_line.end())
         {
-            // parse to remove [
-            next_token.erase(0, 1);
-
-            // check ] exists
-            if (next_token.at(next_token.length() - 1) == ']') // *[reg]
-            {
-                // remove ]
-                next_token.erase(next_token.end() - 1);
-                second_byte = "F" + convert_char_to_hex(convert_registers(next_token)[1]);
-                third_byte = "02";
-                instruction_bytes = first_byte + " " + second_byte + " " + third_byte;
-            }
-            else // *[reg + literal], *[reg + symbol]
-            {
-                second_byte = "F" + convert_char_to_hex(convert_registers(next_token)[1]);
-                third_byte = "03";
-                std::string second_operand = *(++token_iterator); // symbol or literal
-                // remove ]
-                second_operand.erase(second_operand.end() - 1);
-                if (is_literal(second_operand))
-                {
-                    std::string parsed_literal = parse_literal(second_operand);
-                    fourth_byte += parsed_literal[0];
-                    fourth_byte += parsed_literal[1];
-                    fifth_byte += parsed_literal[2];
-                    fifth_byte += parsed_literal[3];
-                }
-                else
-                {
-                    std::string symbol = second_operand;
-                    if (symbol_table.symbol_exists(symbol))
-                    {
-                        unsigned int symbol_id = symbol_table.get_symbol_id(symbol);
-                        unsigned int reloc_id = relocation_table.insert_relocation_record(current_section, location_counter, symbol_id, "R_386_16");
-                        std::string reloc_id_in_hex = parse_literal(std::to_string(reloc_id));
-                        fourth_byte += reloc_id_in_hex[0];
-                        fourth_byte += reloc_id_in_hex[1];
-                        fifth_byte += reloc_id_in_hex[2];
-                        fifth_byte += reloc_id_in_hex[3];
-                    }
-                    else
-                    {
-                        std::cout << "Symbol " << symbol << " does not exist" << std::endl;
-                        return false;
-                    }
-                }
-
-                instruction_bytes = first_byte + " " + second_byte + " " + third_byte + " " + fourth_byte + " " + fifth_byte;
-                location_counter += 2; // for fourth and fifth byte
-            }
+            Operand op;
+            op.value = *(++token_iterator);
+            stmt.operands.push_back(op);
         }
-        else // *literal, *symbol, *reg
+        break;
+    }
+    case KW_EXTERN:
+    {
+        if (debug)
+            diagnostics << "Processing extern directive" << std::endl;
+        while (token_iterator + 1 != tokenized_line.end())
         {
+            std::string_view current_symbol = *(++token_iterator);
             if (debug)
-                std::cout << "Proccessing jmp *literal, *symbol, *reg" << std::endl;
-            // check if it is reg
-            Token_type type = resolve_token_type(next_token);
-            if (type == TOK_REGISTER)
-            {
-                second_byte = "F" + convert_char_to_hex(convert_registers(next_token)[1]);
-                third_byte = "01";
-                instruction_bytes = first_byte + " " + second_byte + " " + third_byte;
-            }
-            else
+                diagnostics << "Procssing extern symbol " << current_symbol << std::endl;
+            if (!define_extern(current_symbol))
             {
-                third_byte = "04";
-                if (is_literal(next_token))
-                {
-                    std::string parsed_literal = parse_literal(next_token);
-                    fourth_byte += parsed_literal[0];
-                    fourth_byte += parsed_literal[1];
-                    fifth_byte += parsed_literal[2];
-                    fifth_byte += parsed_literal[3];
-                }
-                else
-                {
-
-                    std::string symbol = next_token;
-                    if (symbol_table.symbol_exists(symbol))
-                    {
-                        unsigned int symbol_id = symbol_table.get_symbol_id(symbol);
-                        unsigned int reloc_id = relocation_table.insert_relocation_record(current_section, location_counter, symbol_id, "R_386_16");
-                        std::string reloc_id_in_hex = parse_literal(std::to_string(reloc_id));
-                        fourth_byte += reloc_id_in_hex[0];
-                        fourth_byte += reloc_id_in_hex[1];
-                        fifth_byte += reloc_id_in_hex[2];
-                        fifth_byte += reloc_id_in_hex[3];
-                    }
-                    else
-                    {
-                        std::cout << "Symbol " << symbol << " does not exist" << std::endl;
-                        return false;
-                    }
-                }
-                instruction_bytes = first_byte + " " + second_byte + " " + third_byte + " " + fourth_byte + " " + fifth_byte;
-                location_counter += 2; // for fourth and fifth byte
+                diagnostics << "Error inserting symbol with extern " << current_symbol << std::endl;
+                return false;
             }
         }
+        // No processing in second pass
+        return true;
     }
-    else // literal or symbol
+    case KW_EQU:
     {
-        //std::cout << "starting symbol or literal" << std::endl;
-        third_byte = "00";
-        //std::cout << "Processing literal or sybmbol, ";
-        // check if literal
-        if (is_literal(next_token))
-        {
+        if (debug)
+            diagnostics << "Processing equ directive in first pass" << std::endl;
+        std::string_view smb_name, expression;
+        if (!next_token(smb_name) || !next_operand(expression))
+            return false;
+        if (!define_equ(smb_name, expression))
+            return false;
+        // No processing in second pass
+        return true;
+    }
+    case KW_BYTE:
+    case KW_ASCII:
+    case KW_ASCIZ:
+    case KW_INCBIN:
+        if (!first_pass_process_data(stmt))
+            return false;
+        break;
+    case KW_END:
+        if (debug)
+            diagnostics << "Processing end directive" << std::endl;
+        // End of first pass
+        assembling = false;
+        return true;
+    default:
+        diagnostics << "Unrecognized directive " << name << std::endl;
+        return false;
+    }
 
-            //std::cout << "Processing literal and parsing, " << std::endl;
-            std::string parsed_literal = parse_literal(next_token);
-            //std::cout << "parsing finished";
+    location_counter += stmt.size;
+    add_statement(stmt);
+    return true;
+}
+
+bool Assembler::second_pass_process_directive(const Statement &stmt)
+{
+    switch (stmt.id)
+    {
+    case KW_WORD:
+        if (debug)
+            diagnostics << "Processing word directive in second pass" << std::endl;
+        for (std::vector<Operand>::const_iterator it = stmt.operands.begin(); it != stmt.operands.end(); ++it)
+        {
+            if (!process_word_directive(*it))
+                return false;
         }
-        else
-        { // symbol
-            // setup fourth and fifth byte
-            std::string symbol = next_token;
-            if (symbol_table.symbol_exists(symbol))
+        break;
+    case KW_SKIP:
+        if (debug)
+            diagnostics << "Processing skip directive in second pass" << std::endl;
+        // section is already zero filled
+        emit_offset += stmt.size;
+        break;
+    case KW_BYTE:
+    case KW_ASCII:
+    case KW_ASCIZ:
+        return process_data_directive(stmt);
+    case KW_INCBIN:
+        return process_incbin_directive(stmt);
+    case KW_GLOBAL:
+        if (debug)
+            diagnostics << "Processing global directive in second pass" << std::endl;
+        // In second setup symbol that is global referencing to be global
+        for (std::vector<Operand>::const_iterator it = stmt.operands.begin(); it != stmt.operands.end(); ++it)
+        {
+            Symbol_handle smb = symbol_table.find_symbol(it->value);
+            if (smb.record != NULL)
             {
-                unsigned int symbol_id = symbol_table.get_symbol_id(symbol);
-                unsigned int reloc_id = relocation_table.insert_relocation_record(current_section, location_counter, symbol_id, "R_386_16");
-                std::string reloc_id_in_hex = parse_literal(std::to_string(reloc_id));
-                fourth_byte += reloc_id_in_hex[0];
-                fourth_byte += reloc_id_in_hex[1];
-                fifth_byte += reloc_id_in_hex[2];
-                fifth_byte += reloc_id_in_hex[3];
+                smb.record->local = false;
             }
             else
             {
-                std::cout << "Symbol " << symbol << " does not exist" << std::endl;
+                diagnostics << "Error, we have undefined symbol in global directive: " << it->value << std::endl;
                 return false;
             }
         }
-        instruction_bytes = first_byte + " " + second_byte + " " + third_byte + " " + fourth_byte + " " + fifth_byte;
-        location_counter += 2; // for fourth and fifth byte
+        break;
+    default:
+        break;
     }
-    section_table.append_bytecode(current_section, instruction_bytes);
     return true;
 }
 
-bool Assembler::process_ldr_str_instructions(std::string instruction)
+// Next comma separated item of a list read from source, quotes may hold commas and '#'
+static bool next_list_item(std::string_view &list, std::string_view &item)
 {
-    std::string first_byte = "";
-    std::string second_byte = "";
-    std::string third_byte = "";
-    std::string fourth_byte = "";
-    std::string fifth_byte = "";
-    std::string instruction_bytes = "";
+    std::size_t start = list.find_first_not_of(" \t\r");
+    if (start == std::string_view::npos || list[start] == '#')
+        return false;
+
+    std::size_t end = start;
+    char quote = 0;
+    for (; end < list.length(); end++)
+    {
+        char c = list[end];
+        if (quote != 0)
+        {
+            if (c == '\\')
+                end++;
+            else if (c == quote)
+                quote = 0;
+        }
+        else if (c == '"' || c == '\'')
+            quote = c;
+        else if (c == ',' || c == '#')
+            break;
+    }
+    end = std::min(end, list.length());
+
+    item = list.substr(start, end - start);
+    item = item.substr(0, item.find_last_not_of(" \t\r") + 1);
+    list.remove_prefix(end < list.length() && list[end] == ',' ? end + 1 : end);
+    return true;
+}
 
-    //std::cout << "Inside ldr/str " << std::endl;
+bool Assembler::first_pass_process_data(Statement &stmt)
+{
+    // Whole list is kept as one operand, second pass walks it again and writes bytes in place
+    Operand list;
+    list.value = rest_of_line();
+    std::string_view rest = list.value, item;
+    unsigned int size = 0;
+    unsigned int index = 0;
+    std::size_t length;
+    while (next_list_item(rest, item))
+    {
+        if (item.empty())
+        {
+            diagnostics << "Error: missing operand" << std::endl;
+            return false;
+        }
 
-    // setup opcode
-    if (instruction.compare("ldr") == 0)
+        unsigned int literal;
+        Expression expr;
+        Expression_Parser parser(NULL, diagnostics);
+        switch (stmt.id)
+        {
+        case KW_BYTE:
+            // Expression is only checked here, values are range checked when written
+            if (parse_literal(item, literal) != LITERAL_OK && !parser.parse(item, expr))
+                return false;
+            size++;
+            break;
+        case KW_INCBIN:
+            if (index == 0)
+            {
+                if (item[0] != '"')
+                {
+                    diagnostics << "Error: incbin expects quoted file name, got " << item << std::endl;
+                    return false;
+                }
+                break;
+            }
+            if (index > 2)
+            {
+                diagnostics << "Unexpected token " << item << " after incbin" << std::endl;
+                return false;
+            }
+            {
+                // Offset and length have to be known now, like size of .skip
+                Operand op;
+                long long value;
+                if (!evaluate_constant(item, chunk != NULL ? NULL : &symbol_table, value))
+                    return false;
+                if (value < 0 || value > 0x7FFFFFFF)
+                {
+                    diagnostics << "Error: incbin " << (index == 1 ? "offset " : "length ") << item << " out of range" << std::endl;
+                    return false;
+                }
+                op.is_literal = true;
+                op.literal = value;
+                stmt.operands.push_back(op);
+            }
+            break;
+        default:
+            if (!parse_string_literal(item, NULL, length))
+            {
+                diagnostics << "Error: invalid string " << item << std::endl;
+                return false;
+            }
+            size += length + (stmt.id == KW_ASCIZ ? 1 : 0);
+            break;
+        }
+        index++;
+    }
+    if (index == 0)
     {
-        first_byte = "A0";
+        diagnostics << "Error: missing operand" << std::endl;
+        return false;
     }
-    else if (instruction.compare("str") == 0)
+    stmt.operands.insert(stmt.operands.begin(), list);
+    if (stmt.id != KW_INCBIN)
     {
-        first_byte = "B0";
+        stmt.size = size;
+        return true;
     }
-    else
+
+    // Source in memory is assembled without touching files
+    if (in_memory)
     {
-        std::cout << "Unexpected behaviour!" << std::endl;
-        return false; // handle to go to next line
+        diagnostics << "Error: incbin is not supported when assembling from memory" << std::endl;
+        return false;
     }
 
-    // getting the first register and setting it to first half of second byte
-    std::string reg_token = *(++token_iterator);
-    //std::cout << " My reg is " << reg_token << std::endl;
+    // File is only sized here, its bytes are copied when section is written
+    std::string name;
+    std::string_view quoted;
+    rest = list.value;
+    next_list_item(rest, quoted);
+    name.resize(quoted.length());
+    if (!parse_string_literal(quoted, reinterpret_cast<unsigned char *>(&name[0]), length))
+    {
+        diagnostics << "Error: invalid string " << quoted << std::endl;
+        return false;
+    }
+    name.resize(length);
 
-    if (resolve_token_type(reg_token) == TOK_REGISTER)
+    std::error_code error;
+    std::uintmax_t file_size = std::filesystem::file_size(name, error);
+    if (error)
     {
-        second_byte = convert_char_to_hex(convert_registers(reg_token)[1]);
+        diagnostics << "Error: can not read incbin file " << name << std::endl;
+        return false;
     }
-    else
+    std::uintmax_t offset = stmt.operands.size() > 1 ? stmt.operands[1].literal : 0;
+    std::uintmax_t count = stmt.operands.size() > 2 ? stmt.operands[2].literal : (offset <= file_size ? file_size - offset : 0);
+    if (offset + count > file_size || count > 0x7FFFFFFF)
     {
-        std::cout << "Error no register for instruction" << std::endl;
+        diagnostics << "Error: incbin range is outside of file " << name << std::endl;
         return false;
     }
+    if (stmt.operands.size() < 2)
+    {
+        Operand op;
+        op.is_literal = true;
+        op.literal = 0;
+        stmt.operands.push_back(op);
+    }
+    stmt.size = count;
+    return true;
+}
 
-    // Increment for first 2 bytes
-    location_counter += 2;
-
-    // Get operand
-    std::string next_token = *(++token_iterator);
-
-    if (next_token.at(0) == '$') // $<literal>, $<smybol>
+bool Assembler::process_data_directive(const Statement &stmt)
+{
+    std::string_view rest = stmt.operands[0].value, item;
+    unsigned char *out = section_data->bytecode.data();
+    while (next_list_item(rest, item))
     {
-        // resolve if it is symbol or literal
-        second_byte += "0"; // filling up second byte
-        next_token.erase(0, 1);
-        std::string parsed_token = next_token;
-        unsigned int value;
-        std::string value_in_hex;
-        third_byte = "00";
-        location_counter++; // increment for third byte
+        if (stmt.id != KW_BYTE)
+        {
+            std::size_t length;
+            parse_string_literal(item, out + emit_offset, length);
+            emit_offset += length;
+            if (stmt.id == KW_ASCIZ)
+                out[emit_offset++] = 0;
+            continue;
+        }
 
-        // check if literal
-        if (is_literal(next_token))
+        long long value;
+        unsigned int literal;
+        if (parse_literal(item, literal) == LITERAL_OK)
         {
-            std::string parsed_literal = parse_literal(next_token);
-            fourth_byte += parsed_literal[0];
-            fourth_byte += parsed_literal[1];
-            fifth_byte += parsed_literal[2];
-            fifth_byte += parsed_literal[3];
+            value = item[0] == '-' && literal != 0 ? (long long)literal - 0x10000 : literal;
         }
         else
-        { // symbol
-            // setup fourth and fifth byte
-            std::string symbol = next_token;
-            if (symbol_table.symbol_exists(symbol))
-            {
-                unsigned int symbol_id = symbol_table.get_symbol_id(symbol);
-                unsigned int reloc_id = relocation_table.insert_relocation_record(current_section, location_counter, symbol_id, "R_386_16");
-                std::string reloc_id_in_hex = parse_literal(std::to_string(reloc_id));
-                fourth_byte += reloc_id_in_hex[0];
-                fourth_byte += reloc_id_in_hex[1];
-                fifth_byte += reloc_id_in_hex[2];
-                fifth_byte += reloc_id_in_hex[3];
-            }
-            else
-            {
-                std::cout << "Symbol " << symbol << " does not exist" << std::endl;
-                return false;
-            }
-        }
-        instruction_bytes = first_byte + " " + second_byte + " " + third_byte + " " + fourth_byte + " " + fifth_byte;
-        location_counter += 2; // for fourth and fifth byte
-    }
-    else if (next_token.at(0) == '%') // %<symbol> - pc relative
-    {
-        // check if symbol exists
-        next_token.erase(0, 1);
-        std::string symbol = next_token;
-        second_byte += "7"; // filling up second byte - r7 == pc
-        if (symbol_table.symbol_exists(symbol))
         {
-            location_counter++;
-            third_byte = "03"; // without update of regs and reg indirect with 16b move
-            unsigned int symbol_id = symbol_table.get_symbol_id(symbol);
-            unsigned int reloc_id = relocation_table.insert_relocation_record(current_section, location_counter, symbol_id, "R_386_PC16");
-            std::string reloc_id_in_hex = parse_literal(std::to_string(reloc_id));
-            fourth_byte += reloc_id_in_hex[0];
-            fourth_byte += reloc_id_in_hex[1];
-            fifth_byte += reloc_id_in_hex[2];
-            fifth_byte += reloc_id_in_hex[3];
+            // Workers of parallel second pass only read symbols of their parent
+            Assembler &owner = parent != NULL ? *parent : *this;
+            if (options.single_pass && !check_byte_references(item, owner.symbol_table))
+                return false;
+            if (!evaluate_constant(item, &owner.symbol_table, value))
+                return false;
         }
-        else
+        if (value < -128 || value > 255)
         {
-            std::cout << "Symbol " << symbol << " does not exist" << std::endl;
+            diagnostics << "Error: byte value " << item << " does not fit in 8 bits" << std::endl;
             return false;
         }
-        location_counter += 2;
-        instruction_bytes = first_byte + " " + second_byte + " " + third_byte + " " + fourth_byte + " " + fifth_byte;
-    }
-    else if (resolve_token_type(next_token) == TOK_REGISTER)
-    {
-        // processing for second register
-        second_byte += convert_char_to_hex(convert_registers(reg_token)[1]);
-        third_byte = "01";
-        location_counter++; // increment for third byte
-        instruction_bytes = first_byte + " " + second_byte + " " + third_byte;
+        out[emit_offset++] = value & 0xFF;
     }
-    else if (next_token.at(0) == '[') // [<reg>], [<reg> + <literal>] and [<reg> + <symbol>]
-    {
-        second_byte += "0"; // filling up second byte
-        if (debug)
-            std::cout << "Detected [ in ldr/str processing for " << next_token << std::endl;
-        // parse to remove [
-        next_token.erase(0, 1);
+    return true;
+}
 
-        // check ] exists - if exists then it is reg
-        if (next_token.at(next_token.length() - 1) == ']') // [reg]
+bool Assembler::check_byte_references(std::string_view text, Symbol_Table &symbols)
+{
+    // Bytes have no fixups, so a symbol defined later can not be patched in
+    Expression expr;
+    Expression_Parser parser(&symbols, diagnostics);
+    if (!parser.parse(text, expr))
+        return false;
+    for (std::vector<Expression_term>::iterator it = expr.terms.begin(); it != expr.terms.end(); ++it)
+    {
+        if (it->kind == TERM_UNDEFINED)
         {
-            // remove ]
-            next_token.erase(next_token.end() - 1);
-
-            if (resolve_token_type(next_token) != TOK_REGISTER)
-            {
-                std::cout << "Error second register for ldr/str not provided" << std::endl;
-                return false;
-            }
-            second_byte = "F" + convert_char_to_hex(convert_registers(next_token)[1]);
-            third_byte = "02";
-            location_counter++;
-            instruction_bytes = first_byte + " " + second_byte + " " + third_byte;
+            diagnostics << "Error: forward reference " << it->name << " not supported by .byte in single pass" << std::endl;
+            return false;
         }
-        else // [reg + literal], [reg + symbol]
-        {
+    }
+    return true;
+}
 
-            second_byte = "F" + convert_char_to_hex(convert_registers(next_token)[1]);
-            third_byte = "03";
-            location_counter++;
+bool Assembler::process_incbin_directive(const Statement &stmt)
+{
+    std::string_view rest = stmt.operands[0].value, quoted;
+    next_list_item(rest, quoted);
+    std::string name(quoted.length(), '\0');
+    std::size_t length;
+    parse_string_literal(quoted, reinterpret_cast<unsigned char *>(&name[0]), length);
+    name.resize(length);
+
+    // File is mapped and copied in one go, it has to be at least as long as when it was sized
+    Source_File file;
+    unsigned int offset = stmt.operands[1].literal;
+    if (!file.open(name) || file.text().length() < (std::size_t)offset + stmt.size)
+    {
+        diagnostics << "Error: can not read incbin file " << name << std::endl;
+        return false;
+    }
+    std::memcpy(section_data->bytecode.data() + emit_offset, file.text().data() + offset, stmt.size);
+    emit_offset += stmt.size;
+    return true;
+}
 
-            std::string second_operand = *(++token_iterator); // symbol or literal
-            if (debug)
-                std::cout << "Second operand for str/ldr [reg + lit/sym] insruction: " << second_operand << std::endl;
-            // remove ] from second operand
-            second_operand.erase(second_operand.end() - 1);
-            if (is_literal(second_operand))
-            {
-                std::string parsed_literal = parse_literal(second_operand);
-                fourth_byte += parsed_literal[0];
-                fourth_byte += parsed_literal[1];
-                fifth_byte += parsed_literal[2];
-                fifth_byte += parsed_literal[3];
-            }
-            else
-            {
-                std::string symbol = second_operand;
-                if (symbol_table.symbol_exists(symbol))
-                {
-                    unsigned int symbol_id = symbol_table.get_symbol_id(symbol);
-                    unsigned int reloc_id = relocation_table.insert_relocation_record(current_section, location_counter, symbol_id, "R_386_16");
-                    std::string reloc_id_in_hex = parse_literal(std::to_string(reloc_id));
-                    fourth_byte += reloc_id_in_hex[0];
-                    fourth_byte += reloc_id_in_hex[1];
-                    fifth_byte += reloc_id_in_hex[2];
-                    fifth_byte += reloc_id_in_hex[3];
-                }
-                else
-                {
-                    std::cout << "Symbol " << symbol << " does not exist" << std::endl;
-                    return false;
-                }
-            }
+bool Assembler::process_word_directive(const Operand &op)
+{
+    if (debug)
+        diagnostics << "Proccesing word " << op.value << std::endl;
+    if (!emit_payload(op))
+    {
+        diagnostics << "Symbol: " << op.value << " in word directive does not exist" << std::endl;
+        return false;
+    }
+    return true;
+}
 
-            instruction_bytes = first_byte + " " + second_byte + " " + third_byte + " " + fourth_byte + " " + fifth_byte;
-            location_counter += 2; // for fourth and fifth byte
-        }
+bool Assembler::first_pass_process_section(Token_class section_class, std::string_view section)
+{
+    if (section_class.id == KW_SECTION)
+    {
+        if (!next_token(section))
+            return false;
     }
-    else // <Literal> or <Symbol>
+    else
     {
-        second_byte += "0"; // filling up second byte
+        // in case that we have .text or .rodata
+        section.remove_prefix(1);
+    }
 
-        //std::string parsed_token = next_token.substr(0, next_token.length() - 1);
-        third_byte = "04";
-        location_counter++; // for third byte
+    if (chunk != NULL)
+    {
+        // Worker starts new segment, section is looked up when chunks are merged
+        chunk->segments[current_section].size = location_counter;
+        chunk->segments.push_back(chunk_segment(section));
+        current_section = chunk->segments.size() - 1;
+        location_counter = 0;
+        add_statement(statement(STMT_SECTION, section_class, line_number, current_section, location_counter));
+        return true;
+    }
 
-        // check if literal
-        if (is_literal(next_token))
-        {
-            std::string parsed_literal = parse_literal(next_token);
-            fourth_byte += parsed_literal[0];
-            fourth_byte += parsed_literal[1];
-            fifth_byte += parsed_literal[2];
-            fifth_byte += parsed_literal[3];
-        }
-        else
-        { // symbol
-            std::string symbol = next_token;
-            if (symbol_table.symbol_exists(symbol))
-            {
-                unsigned int symbol_id = symbol_table.get_symbol_id(symbol);
-                unsigned int reloc_id = relocation_table.insert_relocation_record(current_section, location_counter, symbol_id, "R_386_16");
-                std::string reloc_id_in_hex = parse_literal(std::to_string(reloc_id));
-                fourth_byte += reloc_id_in_hex[0];
-                fourth_byte += reloc_id_in_hex[1];
-                fifth_byte += reloc_id_in_hex[2];
-                fifth_byte += reloc_id_in_hex[3];
-            }
-            else
-            {
-                std::cout << "Symbol " << symbol << " does not exist" << std::endl;
-                return false;
-            }
-        }
-        instruction_bytes = first_byte + " " + second_byte + " " + third_byte + " " + fourth_byte + " " + fifth_byte;
-        location_counter += 2; // for fourth and fifth byte
+    unsigned int index = section_table.insertSection(std::string(section), 0, 0);
+    if (index == current_section)
+    {
+        diagnostics << "Error: section with same name again defined" << std::endl;
+        return false;
     }
 
-    section_table.append_bytecode(current_section, instruction_bytes);
+    section_table.updateSize(current_section, location_counter);
+
+    // Continue where section ended if it was already opened
+    current_section = index;
+    location_counter = section_table.get_section(index).size;
+
+    add_statement(statement(STMT_SECTION, section_class, line_number, current_section, location_counter));
     return true;
 }
 
-bool Assembler::process_push_pop_instructions(std::string instruction) // maybe done
+bool Assembler::first_pass_process_instruction(Token_class instruction, std::string_view name)
 {
+    Statement stmt = statement(STMT_INSTRUCTION, instruction, line_number, current_section, location_counter);
+    const Instruction_info &info = instruction_table[instruction.id];
+    Operand first, second;
 
-    std::string first_byte = "";
-    std::string second_byte = "";
-    std::string third_byte = "";
-    std::string instruction_bytes = "";
-    std::string reg_to_byte = "";
-    // get next token and check if it is register
-    std::string token = *(++token_iterator); // get next token
-    Token_type token_type = resolve_token_type(token);
-    if (token_type == TOK_REGISTER)
-        second_byte = convert_char_to_hex(token[1]) + convert_char_to_hex(convert_registers("sp")[1]); // regD, sp
-    else
+    switch (info.shape)
     {
-        std::cout << "Expected regS for push or pop" << std::endl;
+    case SHAPE_NONE:
+        break;
+    case SHAPE_REG:
+    case SHAPE_STACK:
+        if (!parse_register_operand(first))
+            return false;
+        stmt.operands.push_back(first);
+        break;
+    case SHAPE_REG_REG:
+        if (!parse_register_operand(first) || !parse_register_operand(second))
+            return false;
+        stmt.operands.push_back(first);
+        stmt.operands.push_back(second);
+        break;
+    case SHAPE_JUMP:
+        if (!parse_jump_operand(first))
+            return false;
+        stmt.operands.push_back(first);
+        break;
+    case SHAPE_REG_DATA:
+        if (!parse_register_operand(first) || !parse_data_operand(second))
+            return false;
+        stmt.operands.push_back(first);
+        stmt.operands.push_back(second);
+        break;
+    default:
+        diagnostics << "Unrecognized instruction " << name << std::endl;
         return false;
     }
 
-    if (instruction.compare("pop") == 0)
+    if (token_iterator + 1 != tokenized_line.end())
     {
-        first_byte = "A0"; // ldr
-        third_byte = "4";
+        diagnostics << "Unexpected token " << *(token_iterator + 1) << " after instruction" << std::endl;
+        return false;
     }
-    else if (instruction.compare("push") == 0)
+
+    Addressing_mode mode = stmt.operands.empty() ? ADDR_NONE : stmt.operands.back().mode;
+    if (info.modes != 0 && (info.modes & mode_bit(mode)) == 0)
     {
-        first_byte = "B0"; // str
-        third_byte = "1";
+        diagnostics << "Error: addressing mode not allowed for " << name << std::endl;
+        return false;
     }
-    else
+
+    // Move location counter according to instruction size
+    stmt.size = instruction_size(stmt.id, mode);
+    stats.count_instruction(stmt.size);
+    location_counter += stmt.size;
+    add_statement(stmt);
+    return true;
+}
+
+bool Assembler::parse_register_operand(Operand &op)
+{
+    std::string_view token;
+    if (!next_token(token))
+        return false;
+    Token_class token_class = classify_token(token);
+    if (token_class.type != TOK_REGISTER)
     {
-        std::cout << "Unrecognized instruction, expceted push or pop" << std::endl;
+        diagnostics << "Error: expected register, got " << token << std::endl;
         return false;
     }
-
-    third_byte += "1";     // reg dir addressing
-    location_counter += 3; // check if not incremented for second byte already
-    instruction_bytes = first_byte + " " + second_byte + " " + third_byte;
-    section_table.append_bytecode(current_section, instruction_bytes);
+    op.mode = ADDR_REG_DIRECT;
+    op.reg = token_class.value;
     return true;
 }
 
-std::string Assembler::convert_char_to_hex(char char_num)
+bool Assembler::parse_jump_operand(Operand &op)
 {
-    try
+    std::string_view token;
+    if (!next_operand(token))
+        return false;
+
+    if (token.at(0) == '%') // %symbol
     {
-        int number = char_num - '0';
-        //std::cout << "Converting " << number << " to integer" << std::endl;
-        std::stringstream sstream;
-        sstream << std::hex << number;
-        std::string hex_num = sstream.str();
-        //std::cout << hex_num << std::endl;
-        return hex_num;
+        op.mode = ADDR_REG_DIRECT_DISP;
+        op.reg = REG_PC;
+        op.pc_relative = true;
+        return parse_expression_operand(token.substr(1), op);
     }
-    catch (std::exception &e)
+    else if (token.at(0) == '*') // *literal, *symbol, *reg, *[reg], *[reg + literal], *[reg + symbol]
     {
-        std::cout << "Standard exception: " << e.what() << std::endl;
-        std::cout << "Exception in converting char to hex " << std::endl;
-        return "";
+        token.remove_prefix(1);
+        if (token.empty())
+            return false;
+        if (token.at(0) == '[')
+            return parse_indirect_operand(token, op);
+        Token_class token_class = classify_token(token);
+        if (token_class.type == TOK_REGISTER)
+        {
+            op.mode = ADDR_REG_DIRECT;
+            op.reg = token_class.value;
+            return true;
+        }
+        op.mode = ADDR_MEMORY;
+        return parse_expression_operand(token, op);
     }
-}
 
-std::string Assembler::convert_registers(std::string reg)
-{
-    if (reg.compare("psw") == 0)
-        return "r8";
-    else if (reg.compare("pc") == 0)
-        return "r7";
-    else if (reg.compare("sp") == 0)
-        return "r6";
-    else
-        return reg;
+    // literal or symbol
+    op.mode = ADDR_IMMEDIATE;
+    return parse_expression_operand(token, op);
 }
 
-std::string Assembler::resolve_registers()
+bool Assembler::parse_data_operand(Operand &op)
 {
-    std::string reg_token_one = *(++token_iterator);
-    std::string reg_token_two = *(++token_iterator);
-    std::string ret_val = "";
-    if (resolve_token_type(reg_token_one) == TOK_REGISTER && resolve_token_type(reg_token_two) == TOK_REGISTER)
+    std::string_view token;
+    if (!next_operand(token))
+        return false;
+
+    if (token.at(0) == '$') // $<literal>, $<smybol>
+    {
+        op.mode = ADDR_IMMEDIATE;
+        return parse_expression_operand(token.substr(1), op);
+    }
+    else if (token.at(0) == '%') // %<symbol> - pc relative
     {
+        op.mode = ADDR_REG_INDIRECT_DISP;
+        op.reg = REG_PC;
+        op.pc_relative = true;
+        return parse_expression_operand(token.substr(1), op);
+    }
 
-        ret_val = convert_char_to_hex(convert_registers(reg_token_one)[1]) +
-                  convert_char_to_hex(convert_registers(reg_token_two)[1]);
+    Token_class token_class = classify_token(token);
+    if (token_class.type == TOK_REGISTER)
+    {
+        op.mode = ADDR_REG_DIRECT;
+        op.reg = token_class.value;
+        return true;
     }
-    else
+    else if (token.at(0) == '[') // [<reg>], [<reg> + <literal>] and [<reg> + <symbol>]
     {
-        std::cout << "Error no registers for instruction" << std::endl;
+        return parse_indirect_operand(token, op);
     }
-    return ret_val;
+
+    // <Literal> or <Symbol>
+    op.mode = ADDR_MEMORY;
+    return parse_expression_operand(token, op);
 }
 
-bool Assembler::is_literal(std::string literal)
+bool Assembler::parse_indirect_operand(std::string_view token, Operand &op)
 {
-    if (!literal.empty() && std::all_of(literal.begin(), literal.end(), ::isdigit))
+    // parse to remove [ and ], operand spans all tokens up to the next comma
+    if (token.length() < 2 || token.at(token.length() - 1) != ']')
     {
-        return true;
+        diagnostics << "Error: expected ] after " << token << std::endl;
+        return false;
     }
-    else if (literal.compare(0, 2, "0x") == 0 && literal.size() > 2 && literal.find_first_not_of("0123456789abcdefABCDEF", 2) == std::string::npos)
+    token = token.substr(1, token.length() - 2);
+
+    std::size_t start = token.find_first_not_of(" \t");
+    std::size_t end = start == std::string_view::npos ? token.length() : token.find_first_of(" \t+-", start);
+    std::string_view reg = start == std::string_view::npos ? token : token.substr(start, end - start);
+    Token_class token_class = classify_token(reg);
+    if (token_class.type != TOK_REGISTER)
     {
+        diagnostics << "Error: expected register inside [], got " << reg << std::endl;
+        return false;
+    }
+    op.reg = token_class.value;
+
+    std::string_view displacement = token.substr(std::min(end, token.length()));
+    start = displacement.find_first_not_of(" \t");
+    if (start == std::string_view::npos)
+    {
+        op.mode = ADDR_REG_INDIRECT;
         return true;
     }
 
-    return false;
+    // [reg + expression], [reg - expression]
+    displacement.remove_prefix(start);
+    if (displacement.at(0) == '+')
+        displacement.remove_prefix(1);
+    else if (displacement.at(0) != '-')
+    {
+        diagnostics << "Error: expected + after register in " << token << std::endl;
+        return false;
+    }
+
+    op.mode = ADDR_REG_INDIRECT_DISP;
+    return parse_expression_operand(displacement, op);
 }
 
-std::string Assembler::parse_literal(std::string literal)
+bool Assembler::second_pass_process_instruction(const Statement &stmt)
 {
+    if (debug)
+        diagnostics << "Processing second pass instruction" << std::endl;
+
+    const Instruction_info &info = instruction_table[stmt.id];
+    emit_byte(info.opcode);
 
-    // Decimal number transforming
-    if (!literal.empty() && std::all_of(literal.begin(), literal.end(), ::isdigit))
+    switch (info.shape)
     {
-        // Convert decimal to hex
-        //std::cout << " It is decimal: " << literal << std::endl;
-        int number = std::stoi(literal);
-        std::stringstream sstream;
-        sstream << std::hex << number;
-        std::string hex_format_literal = sstream.str();
+    case SHAPE_NONE:
+        return true;
+    case SHAPE_REG:
+        emit_byte(stmt.operands[0].reg << 4 | info.fill);
+        return true;
+    case SHAPE_REG_REG:
+        emit_byte(stmt.operands[0].reg << 4 | stmt.operands[1].reg);
+        return true;
+    case SHAPE_STACK:
+        emit_byte(stmt.operands[0].reg << 4 | REG_SP);
+        emit_byte(info.update_mode);
+        return true;
+    default:
+    {
+        // Jumps have no destination register, regS is 0 for operands without register
+        const Operand &op = stmt.operands.back();
+        unsigned char destination = info.shape == SHAPE_JUMP ? info.fill : stmt.operands[0].reg;
+        emit_byte(destination << 4 | (op.reg == 0xF ? 0 : op.reg));
+        emit_byte(op.mode);
+        if (mode_has_payload(op.mode))
+            return emit_payload(op);
+        return true;
+    }
+    }
+}
 
-        // insert zeros
-        std::string transformed_literal = "";
-        while (hex_format_literal.size() % 2 != 0 || hex_format_literal.size() < 3)
-            hex_format_literal.insert(0, "0");
+bool Assembler::emit_payload(const Operand &op)
+{
+    if (op.is_literal)
+    {
+        emit_word(op.literal);
+        return true;
+    }
 
-        //std::cout << "Hex format literal: " << hex_format_literal << std::endl;
-        for (int i = hex_format_literal.size(); i > 0; i = i - 2)
+    // Workers of parallel second pass only read symbols and sections of their parent
+    Assembler &owner = parent != NULL ? *parent : *this;
+    if (!op.expression)
+    {
+        Symbol_handle smb = owner.symbol_table.find_symbol(op.value);
+        if (smb.record == NULL && options.single_pass)
+        {
+            // Forward reference, payload is written when symbol is defined
+            add_fixup(op.value, op.pc_relative, 0);
+        }
+        else if (smb.record == NULL)
+        {
+            diagnostics << "Symbol " << op.value << " does not exist" << std::endl;
+            return false;
+        }
+        else
         {
-            // hex number 0xF5A4
-            // transforming in pairs of 2 bytes, replace places of first and last
-            // first iteration: transformed_literal = F5
-            // second iteration: transformed_literal = A4F5
-            transformed_literal += hex_format_literal.substr(i - 2, 1);
-            transformed_literal += hex_format_literal.substr(i - 1, 1);
+            resolve_reference(*smb.record, smb.id, current_section, emit_offset, op.pc_relative, 0);
         }
-        // std::cout << "Transfomrted literal to hex " << transformed_literal << std::endl;
-        return transformed_literal;
+        emit_offset += 2;
+        return true;
     }
-    // Hex number transforming
-    else if (literal.compare(0, 2, "0x") == 0 && literal.size() > 2 && literal.find_first_not_of("0123456789abcdefABCDEF", 2) == std::string::npos)
-    {
-        std::string hex_format_literal = literal.substr(2, literal.length());
-        //std::cout << "Hex number without 0x : " << hex_format_literal << std::endl;
-        std::string transformed_literal = "";
 
-        while (hex_format_literal.size() % 2 != 0 || hex_format_literal.size() < 3)
-            hex_format_literal.insert(0, "0");
+    Expression expr;
+    Expression_Parser parser(&owner.symbol_table, diagnostics);
+    if (!parser.parse(op.value, expr))
+        return false;
 
-        for (int i = hex_format_literal.size(); i > 0; i = i - 2)
+    // Single pass can leave one forward reference, it is patched with the addend once defined
+    unsigned int undefined = 0;
+    for (std::vector<Expression_term>::iterator it = expr.terms.begin(); it != expr.terms.end(); ++it)
+    {
+        if (it->kind != TERM_UNDEFINED)
+            continue;
+        if (!options.single_pass)
+        {
+            diagnostics << "Symbol " << it->name << " does not exist" << std::endl;
+            return false;
+        }
+        // Fixup adds symbol value to the payload, anything else needs the value while parsing
+        if (it->folded || it->coefficient != 1)
         {
-            // hex number 0xF5A4
-            // first iteration: transformed_literal = F5
-            // second iteration: transformed_literal = A4F5
-            transformed_literal += hex_format_literal.substr(i - 2, 1);
-            transformed_literal += hex_format_literal.substr(i - 1, 1);
+            diagnostics << "Error: forward reference must be symbol +/- constant in single pass in expression "
+                        << op.value << std::endl;
+            return false;
         }
-        //std::cout << "Transfomrted literal to hex " << transformed_literal << std::endl;
-        return transformed_literal;
+        undefined++;
+    }
+    if (undefined > 1)
+    {
+        diagnostics << "Error: forward reference in expression " << op.value << " is not supported in single pass mode" << std::endl;
+        return false;
+    }
+    if (!reduce_expression(expr, op.pc_relative))
+    {
+        diagnostics << "Error: expression " << op.value << " has to be constant or symbol plus constant" << std::endl;
+        return false;
     }
+    if (!fits_16_bits(expr.constant))
+    {
+        diagnostics << "Error: expression " << op.value << " does not fit in 16 bits" << std::endl;
+        return false;
+    }
+    if (undefined > 0 && (expr.terms.empty() || expr.terms[0].kind != TERM_UNDEFINED))
+    {
+        diagnostics << "Error: forward reference in expression " << op.value << " is not supported in single pass mode" << std::endl;
+        return false;
+    }
+
+    if (expr.terms.empty())
+    {
+        if (op.pc_relative)
+        {
+            diagnostics << "Error: pc relative operand " << op.value << " needs a symbol" << std::endl;
+            return false;
+        }
+        emit_word(expr.constant);
+        return true;
+    }
+
+    const Expression_term &base = expr.terms[0];
+    if (base.kind == TERM_UNDEFINED)
+        add_fixup(base.name, op.pc_relative, expr.constant);
+    else
+        resolve_reference(owner.symbol_table.get_symbol(base.symbol), base.symbol, current_section, emit_offset,
+                          op.pc_relative, expr.constant);
+    emit_offset += 2;
+    return true;
+}
+
+void Assembler::resolve_reference(const Symbol &smb, unsigned int smb_id, unsigned int section, unsigned int offset,
+                                  bool pc_relative, long long addend)
+{
+    // Payload is the last field of instruction, so pc points right after it
+    unsigned int value;
+    if (pc_relative && smb.section == section)
+        value = smb.offset + addend - (offset + 2);
+    else if (!pc_relative && smb.section == Section_Table::ABSOLUTE)
+        value = smb.offset + addend;
     else
     {
-        std::cout << "Error: Unidentified literal" << std::endl;
+        // Left to linker, addend is in place: S + A for absolute and S + A - P for pc relative
+        relocation_table.insert_relocation_record(section, offset, smb_id, pc_relative ? R_386_PC16 : R_386_16);
+        value = pc_relative ? addend - 2 : addend;
     }
 
-    return literal;
+    // Worker writes into sections of its parent, single pass can patch a section it already left
+    std::vector<unsigned char> &bytecode = (parent != NULL ? parent->section_table : section_table).get_section(section).bytecode;
+    bytecode[offset] = value & 0xFF;
+    bytecode[offset + 1] = (value >> 8) & 0xFF;
 }
 
-void Assembler::increment_counter_for_three_or_more_bytes_instruction(std::string instruction)
+void Assembler::emit_byte(unsigned char byte)
 {
+    section_data->bytecode[emit_offset++] = byte;
+}
+
+void Assembler::emit_word(unsigned int word)
+{
+    // little endian
+    section_data->bytecode[emit_offset++] = word & 0xFF;
+    section_data->bytecode[emit_offset++] = (word >> 8) & 0xFF;
+}
 
-    if (instruction.compare("push") == 0 || instruction.compare("pop") == 0)
-        location_counter += 3;
-    else if (instruction.compare("ldr") == 0 || instruction.compare("str") == 0)
+bool Assembler::parse_expression_operand(std::string_view text, Operand &op)
+{
+    // Expressions without symbols are folded here, second pass only copies the value
+    std::size_t start = text.find_first_not_of(" \t");
+    text = start == std::string_view::npos ? std::string_view() : text.substr(start, text.find_last_not_of(" \t") - start + 1);
+    op.value = text;
+    op.is_literal = false;
+    op.expression = false;
+    if (is_symbol_name(text))
+        return true;
+    if (!op.pc_relative && parse_literal(text, op.literal) == LITERAL_OK)
     {
-        std::string next_token = *(++token_iterator); // get regD
-        next_token = *(++token_iterator);             // get Operand
+        op.is_literal = true;
+        return true;
+    }
 
-        if (resolve_token_type(next_token) == TOK_REGISTER) // reg (for ldr/str)
-        {
-            location_counter += 3;
-        }
-        else if (next_token.at(0) == '[')
-        {
-            // parse to remove [
-            next_token.erase(0, 1);
-            // check ] exists
-            if (next_token.at(next_token.length() - 1) == ']') // [reg]
-            {
-                location_counter += 3;
-            }
-            else
-                location_counter += 5;
-        }
-        else // in other cases location counter is 5
-        {
-            //std::cout << "Incrementing LC for 5" << std::endl;
-            location_counter += 5;
-        }
+    Expression expr;
+    Expression_Parser parser(NULL, diagnostics);
+    if (!parser.parse(text, expr))
+        return false;
+    if (!expr.terms.empty())
+    {
+        op.expression = true;
+        return true;
     }
-    else // jmp instructions, call, ldr, str
+    if (op.pc_relative)
     {
-        // get next token
-        std::string next_token = *(++token_iterator); // get operand
-
-        if (next_token.at(0) == '*') // *literal, *symbol, *reg, *[reg], *[reg + literal], *[reg + symbol]
-        {
-            next_token.erase(0, 1);
-            if (next_token.at(0) == '[') // *[reg]
-            {
-                // parse to remove [
-                next_token.erase(0, 1);
-                // check ] exists
-                if (next_token.at(next_token.length() - 1) == ']') // *[reg]
-                {
-                    location_counter += 3;
-                }
-                else
-                    location_counter += 5;
-            }
-            else // *reg
-            {
-                if (resolve_token_type(next_token) == TOK_REGISTER)
-                {
-                    location_counter += 3;
-                }
-                else
-                {
-                    std::cout << "Unexpected case in increment_counter_for_three_or_more_bytes_instruction" << std::endl;
-                }
-            }
-        }
-        else // in other cases location counter is 5
-        {
-            location_counter += 5;
-        }
+        diagnostics << "Error: pc relative operand " << text << " needs a symbol" << std::endl;
+        return false;
+    }
+    if (!fits_16_bits(expr.constant))
+    {
+        diagnostics << "Error: expression " << text << " does not fit in 16 bits" << std::endl;
+        return false;
     }
-}
\ No newline at end of file
+    op.is_literal = true;
+    op.literal = expr.constant & 0xFFFF;
+    return true;
+}
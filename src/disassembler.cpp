@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "../inc/disassembler.hpp"
+
+static const char *const register_names[REG_PSW + 1] = {"r0", "r1", "r2", "r3", "r4", "r5", "sp", "pc", "psw"};
+
+// Modes without register have 0 in its place
+static const unsigned short NO_REGISTER_MODES = mode_bit(ADDR_IMMEDIATE) | mode_bit(ADDR_MEMORY);
+static const unsigned short PAYLOAD_MODES = mode_bit(ADDR_IMMEDIATE) | mode_bit(ADDR_REG_INDIRECT_DISP) |
+                                            mode_bit(ADDR_MEMORY) | mode_bit(ADDR_REG_DIRECT_DISP);
+
+bool decode_instruction(const unsigned char *bytes, std::size_t available, Decoded_instruction &ins)
+{
+    if (available == 0)
+        return false;
+    const Opcode_entry &entry = opcode_table.entry[bytes[0]];
+    if (available < entry.size)
+        return false;
+
+    ins.id = static_cast<Keyword_id>(entry.id);
+    ins.size = entry.size;
+    ins.d = 0;
+    ins.s = 0;
+    ins.mode = ADDR_NONE;
+    ins.payload = 0;
+    if (entry.size < 2)
+        return entry.id != NO_INSTRUCTION;
+
+    ins.d = bytes[1] >> 4;
+    ins.s = bytes[1] & 0xF;
+    if (entry.size == 2)
+        return (entry.d_mask >> ins.d) & (entry.s_mask >> ins.s) & 1;
+
+    // Assembler writes no update for instructions other than push and pop
+    unsigned int mode = bytes[2];
+    unsigned int s_mask = (NO_REGISTER_MODES >> (mode & 0xF)) & 1 ? 1 : entry.s_mask;
+    bool valid = mode < 16 && ((entry.modes >> mode) & (entry.d_mask >> ins.d) & (s_mask >> ins.s) & 1);
+    if (!valid)
+    {
+        // ldr and str through sp with the update of pop and push are those instructions
+        if (entry.stack_id == NO_INSTRUCTION || ins.s != REG_SP || mode != entry.stack_update || ins.d > REG_PSW)
+            return false;
+        ins.id = static_cast<Keyword_id>(entry.stack_id);
+        return true;
+    }
+
+    ins.mode = static_cast<Addressing_mode>(mode);
+    if ((PAYLOAD_MODES >> mode) & 1)
+    {
+        if (available < entry.size + 2u)
+            return false;
+        ins.size += 2;
+        ins.payload = bytes[3] | (bytes[4] << 8);
+    }
+    return true;
+}
+
+std::string format_instruction(const Decoded_instruction &ins, std::string_view payload_text)
+{
+    const Instruction_info &info = instruction_table[ins.id];
+    std::string text = keywords[ins.id].name;
+    char number[8];
+    std::snprintf(number, sizeof(number), "0x%04X", ins.payload);
+    std::string payload = payload_text.empty() ? std::string(number) : std::string(payload_text);
+    // int has the fill in place of second register
+    std::string s = ins.s <= REG_PSW ? register_names[ins.s] : "";
+
+    switch (info.shape)
+    {
+    case SHAPE_NONE:
+        return text;
+    case SHAPE_REG:
+    case SHAPE_STACK:
+        return text + " " + register_names[ins.d];
+    case SHAPE_REG_REG:
+        return text + " " + register_names[ins.d] + ", " + s;
+    default:
+        break;
+    }
+
+    // Operand in the syntax parse_jump_operand and parse_data_operand read
+    bool jump = info.shape == SHAPE_JUMP;
+    std::string operand;
+    switch (ins.mode)
+    {
+    case ADDR_IMMEDIATE:
+        operand = jump ? payload : "$" + payload;
+        break;
+    case ADDR_REG_DIRECT:
+        operand = jump ? "*" + s : s;
+        break;
+    case ADDR_REG_INDIRECT:
+        operand = (jump ? "*[" : "[") + s + "]";
+        break;
+    case ADDR_MEMORY:
+        operand = jump ? "*" + payload : payload;
+        break;
+    default:
+        // pc relative forms are written as %, other displacements as [reg + disp]
+        if (ins.s == REG_PC)
+            operand = "%" + payload;
+        else
+            operand = (jump ? "*[" : "[") + s + " + " + payload + "]";
+        break;
+    }
+    return jump ? text + " " + operand : text + " " + register_names[ins.d] + ", " + operand;
+}
+
+Disassembler::Disassembler(std::vector<std::string> inputs, std::string DestName, Disassembler_options options)
+{
+    this->inputs = inputs;
+    this->DestName = DestName;
+    this->options = options;
+}
+
+std::string Disassembler::get_diagnostics()
+{
+    return diagnostics.str();
+}
+
+bool Disassembler::disassemble()
+{
+    std::ofstream file;
+    std::ostream *out = &std::cout;
+    if (!DestName.empty())
+    {
+        file.open(DestName, std::ios::out | std::ios::trunc);
+        if (!file.is_open())
+        {
+            diagnostics << "Output file error: " << DestName << std::endl;
+            return false;
+        }
+        out = &file;
+    }
+
+    bool no_errors = true;
+    unsigned long long decoded = 0;
+    unsigned long long instructions = 0;
+    double seconds = 0;
+    for (const std::string &name : inputs)
+    {
+        Object_File object;
+        if (!object.open(name))
+        {
+            diagnostics << "Error: " << name << " is not a valid object file" << std::endl;
+            no_errors = false;
+            continue;
+        }
+        *out << "# file: " << name << std::endl;
+        for (unsigned int i = 0; i < object.header()->section_count; i++)
+            disassemble_section(object, i, *out);
+        *out << std::endl;
+
+        if (options.stats)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            decode_all(object, decoded, instructions);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    if (options.stats)
+        diagnostics << "Decoded " << decoded << " bytes, " << instructions << " instructions in " << std::fixed << std::setprecision(3) << seconds * 1000
+                    << " ms, " << std::setprecision(1) << (seconds > 0 ? decoded / seconds / 1e6 : 0) << " MB/s" << std::endl;
+    return no_errors;
+}
+
+// Only decodes, for the speed in --stats
+void Disassembler::decode_all(Object_File &file, unsigned long long &bytes, unsigned long long &instructions)
+{
+    for (unsigned int i = 0; i < file.header()->section_count; i++)
+    {
+        const Object_section *sec = file.section(i);
+        if (sec->type != SECTION_PROGBITS)
+            continue;
+        const unsigned char *data = file.section_data(i);
+        unsigned int offset = 0;
+        Decoded_instruction ins;
+        while (offset < sec->data_size)
+        {
+            if (decode_instruction(data + offset, sec->data_size - offset, ins))
+            {
+                offset += ins.size;
+                instructions++;
+            }
+            else
+                offset++;
+        }
+        bytes += sec->data_size;
+    }
+}
+
+// Symbol plus addend of a payload left to the linker. The addend is in place, pc relative
+// ones hold A - 2
+std::string Disassembler::relocation_text(Object_File &file, const Relocation_record &rel, unsigned short payload)
+{
+    std::string text = file.string(file.symbol(rel.symbol_id)->name);
+    int addend = static_cast<short>(payload) + (rel.type == R_386_PC16 ? 2 : 0);
+    if (addend > 0)
+        text += " + " + std::to_string(addend);
+    else if (addend < 0)
+        text += " - " + std::to_string(-addend);
+    return text;
+}
+
+void Disassembler::disassemble_section(Object_File &file, unsigned int index, std::ostream &out)
+{
+    const Object_section *sec = file.section(index);
+    if (sec->type == SECTION_UNDEFINED)
+        return;
+    out << std::endl
+        << ".section " << file.string(sec->name) << std::endl;
+
+    std::vector<std::pair<unsigned int, const char *>> labels;
+    for (unsigned int i = 0; i < file.header()->symbol_count; i++)
+    {
+        const Object_symbol *smb = file.symbol(i);
+        if (smb->section == index)
+            labels.push_back(std::make_pair(smb->value, file.string(smb->name)));
+    }
+    std::stable_sort(labels.begin(), labels.end(), [](const std::pair<unsigned int, const char *> &a, const std::pair<unsigned int, const char *> &b)
+                     { return a.first < b.first; });
+
+    const unsigned char *data = file.section_data(index);
+    const Relocation_record *relocations = file.relocations(index);
+    unsigned int next_relocation = 0;
+    unsigned int next_label = 0;
+    unsigned int offset = 0;
+    char line[64];
+    while (offset < sec->data_size)
+    {
+        while (next_label < labels.size() && labels[next_label].first <= offset)
+            out << labels[next_label++].second << ":" << std::endl;
+        while (next_relocation < sec->relocation_count && relocations[next_relocation].offset < offset)
+            next_relocation++;
+
+        // Instructions do not run over a label, bytes before it are data
+        unsigned int end = next_label < labels.size() ? std::min(labels[next_label].first, sec->data_size) : sec->data_size;
+        // Relocated word that is not a payload, as in .word of a label
+        if (next_relocation < sec->relocation_count && relocations[next_relocation].offset == offset && end - offset >= 2)
+        {
+            std::string word = relocation_text(file, relocations[next_relocation], data[offset] | (data[offset + 1] << 8));
+            std::snprintf(line, sizeof(line), "  %04X:  %02X %02X %-10s.word ", offset, data[offset], data[offset + 1], "");
+            out << line << word << std::endl;
+            offset += 2;
+            continue;
+        }
+
+        Decoded_instruction ins;
+        if (!decode_instruction(data + offset, end - offset, ins))
+        {
+            std::snprintf(line, sizeof(line), "  %04X:  %02X %-13s.byte 0x%02X", offset, data[offset], "", data[offset]);
+            out << line << std::endl;
+            offset++;
+            continue;
+        }
+
+        std::string payload_text;
+        std::string comment;
+        bool pc_relative = (ins.mode == ADDR_REG_INDIRECT_DISP || ins.mode == ADDR_REG_DIRECT_DISP) && ins.s == REG_PC;
+        if (ins.size == 5 && next_relocation < sec->relocation_count && relocations[next_relocation].offset == offset + 3)
+            payload_text = relocation_text(file, relocations[next_relocation], ins.payload);
+        else if (pc_relative)
+        {
+            // Resolved pc relative payload points into this section
+            unsigned int target = (offset + ins.size + ins.payload) & 0xFFFF;
+            for (unsigned int i = 0; i < labels.size() && payload_text.empty(); i++)
+            {
+                if (labels[i].first == target)
+                    payload_text = labels[i].second;
+            }
+            std::snprintf(line, sizeof(line), "  # 0x%04X", target);
+            comment = line;
+        }
+
+        std::string bytes;
+        for (unsigned int i = 0; i < ins.size; i++)
+        {
+            std::snprintf(line, sizeof(line), "%02X ", data[offset + i]);
+            bytes += line;
+        }
+        std::snprintf(line, sizeof(line), "  %04X:  %-16s", offset, bytes.c_str());
+        out << line << format_instruction(ins, payload_text) << comment << std::endl;
+        offset += ins.size;
+    }
+
+    // Zero fill that is not stored, with labels inside it
+    while (offset < sec->size || next_label < labels.size())
+    {
+        unsigned int end = next_label < labels.size() ? std::min(labels[next_label].first, sec->size) : sec->size;
+        if (end > offset)
+        {
+            std::snprintf(line, sizeof(line), "  %04X:  %-16s.skip %u", offset, "", end - offset);
+            out << line << std::endl;
+            offset = end;
+        }
+        if (next_label < labels.size())
+            out << labels[next_label++].second << ":" << std::endl;
+    }
+}
@@ -0,0 +1,57 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../inc/disassembler.hpp"
+
+static void print_usage()
+{
+    std::cout << "Usage: disassembler [--stats] [-o output_file] input_file.o..." << std::endl;
+    std::cout << "  -o output_file      write assembly to file instead of standard output" << std::endl;
+    std::cout << "  --stats             print decode speed" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string DestName;
+    std::vector<std::string> inputs;
+    Disassembler_options options;
+
+    // Command: disassembler -o program.txt interrupts.o main.o
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+        {
+            DestName = argv[++i];
+        }
+        else if (arg == "--stats")
+        {
+            options.stats = true;
+        }
+        else if (arg[0] == '-')
+        {
+            print_usage();
+            return 1;
+        }
+        else
+        {
+            inputs.push_back(arg);
+        }
+    }
+
+    if (inputs.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    Disassembler disassembler(inputs, DestName, options);
+    bool no_errors = disassembler.disassemble();
+    std::cout << disassembler.get_diagnostics();
+    if (!no_errors)
+        std::cout << std::endl
+                  << "Disassembly failed!" << std::endl;
+    return no_errors ? 0 : 1;
+}
@@ -0,0 +1,761 @@
+#include <fstream>
+#include <iomanip>
+#include <cstdio>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "../inc/emulator.hpp"
+#include "../inc/jit.hpp"
+
+static struct termios saved_terminal;
+
+// Timer period in milliseconds for every value of tim_cfg
+static const unsigned int timer_periods[8] = {500, 1000, 1500, 2000, 5000, 10000, 30000, 60000};
+
+Emulator::Emulator(Emulator_options options)
+    : memory(MEMORY_SIZE + 4, 0), cache(MEMORY_SIZE), code(MEMORY_SIZE + 4, 0)
+{
+    this->options = options;
+    decode_handler = NULL;
+    jit = NULL;
+    for (unsigned int i = 0; i < EMU_REGISTERS; i++)
+        r[i] = 0;
+    executed = 0;
+    term_in = 0;
+    tim_cfg = 0;
+    terminal_pending = false;
+    timer_pending = false;
+    input_open = true;
+    raw_terminal = false;
+}
+
+Emulator::~Emulator()
+{
+    stop_terminal();
+    delete jit;
+}
+
+std::string Emulator::get_diagnostics()
+{
+    return diagnostics.str();
+}
+
+bool Emulator::load(std::string name)
+{
+    std::ifstream input(name, std::ios::binary);
+    if (!input.is_open())
+    {
+        diagnostics << "Input file error: " << name << std::endl;
+        return false;
+    }
+    input.read(reinterpret_cast<char *>(memory.data()), MMIO_START);
+    if (input.peek() != EOF)
+    {
+        diagnostics << "Error: image " << name << " overlaps memory mapped registers" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Emulator::start_terminal()
+{
+    // Characters are delivered as they are typed, without echo
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved_terminal) != 0)
+        return;
+    struct termios raw = saved_terminal;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    raw_terminal = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+}
+
+void Emulator::stop_terminal()
+{
+    if (raw_terminal)
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_terminal);
+    raw_terminal = false;
+}
+
+inline unsigned short Emulator::read_word(unsigned short address)
+{
+    if (address < MMIO_START)
+        return memory[address] | (memory[address + 1] << 8);
+    if (address == TERM_IN)
+        return term_in;
+    if (address == TIM_CFG)
+        return tim_cfg;
+    return 0;
+}
+
+inline void Emulator::write_word(unsigned short address, unsigned short value)
+{
+    if (address >= MMIO_START)
+    {
+        if (address == TERM_OUT)
+            std::putchar(value & 0xFF);
+        else if (address == TIM_CFG)
+        {
+            tim_cfg = value;
+            next_tick = std::chrono::steady_clock::now() + std::chrono::milliseconds(timer_periods[tim_cfg & 7]);
+        }
+        return;
+    }
+    memory[address] = value & 0xFF;
+    memory[address + 1] = value >> 8;
+
+    // Instructions that cover written bytes are decoded again, they start at most 4 bytes before
+    if (code[address] | code[address + 1])
+    {
+        for (unsigned int i = 0; i < 6; i++)
+        {
+            Decoded &entry = cache[(address - 4 + i) & 0xFFFF];
+            entry.handler = decode_handler;
+            entry.size = 0;
+        }
+        // Translated code is never written, it leaves to the interpreter first
+        if (jit != NULL)
+            jit->flush();
+    }
+}
+
+inline void Emulator::push(unsigned short value)
+{
+    r[EMU_SP] -= 2;
+    write_word(r[EMU_SP], value);
+}
+
+inline unsigned short Emulator::pop()
+{
+    unsigned short value = read_word(r[EMU_SP]);
+    r[EMU_SP] += 2;
+    return value;
+}
+
+void Emulator::interrupt(unsigned int entry)
+{
+    push(r[EMU_PC]);
+    push(r[EMU_PSW]);
+    r[EMU_PC] = read_word(entry * 2);
+}
+
+void Emulator::poll_devices()
+{
+    std::fflush(stdout);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now >= next_tick)
+    {
+        timer_pending = true;
+        next_tick = now + std::chrono::milliseconds(timer_periods[tim_cfg & 7]);
+    }
+
+    // Next character is read only when the last one was taken
+    struct pollfd input = {STDIN_FILENO, POLLIN, 0};
+    if (input_open && !terminal_pending && poll(&input, 1, 0) > 0)
+    {
+        unsigned char c;
+        if (read(STDIN_FILENO, &c, 1) == 1)
+        {
+            term_in = c;
+            terminal_pending = true;
+        }
+        else
+            input_open = false;
+    }
+
+    // Interrupts without handler in vector table are dropped
+    if (timer_pending && read_word(IVT_TIMER * 2) == 0)
+        timer_pending = false;
+    if (terminal_pending && read_word(IVT_TERMINAL * 2) == 0)
+        terminal_pending = false;
+
+    // One interrupt at a time, handler runs with interrupts masked until iret
+    if (r[EMU_PSW] & PSW_I)
+        return;
+    if (timer_pending && !(r[EMU_PSW] & PSW_TR))
+    {
+        timer_pending = false;
+        interrupt(IVT_TIMER);
+        r[EMU_PSW] |= PSW_I;
+    }
+    else if (terminal_pending && !(r[EMU_PSW] & PSW_TL))
+    {
+        terminal_pending = false;
+        interrupt(IVT_TERMINAL);
+        r[EMU_PSW] |= PSW_I;
+    }
+}
+
+// Arithmetic, logic and shifts on a, false for division by zero
+inline bool Emulator::alu(unsigned int id, unsigned short &a, unsigned short b)
+{
+    unsigned short value;
+    unsigned int count = b;
+    bool carry;
+    switch (id)
+    {
+    case H_ADD:
+        a += b;
+        return true;
+    case H_SUB:
+        a -= b;
+        return true;
+    case H_MUL:
+        a *= b;
+        return true;
+    case H_DIV:
+        if (b == 0)
+            return false;
+        a /= b;
+        return true;
+    case H_CMP:
+        value = a - b;
+        r[EMU_PSW] = (r[EMU_PSW] & ~(PSW_Z | PSW_O | PSW_C | PSW_N)) |
+                     (value == 0 ? PSW_Z : 0) | ((a ^ b) & (a ^ value) & 0x8000 ? PSW_O : 0) |
+                     (a < b ? PSW_C : 0) | (value & 0x8000 ? PSW_N : 0);
+        return true;
+    case H_NOT:
+        a = ~a;
+        return true;
+    case H_AND:
+        a &= b;
+        return true;
+    case H_OR:
+        a |= b;
+        return true;
+    case H_XOR:
+        a ^= b;
+        return true;
+    case H_TEST:
+        value = a & b;
+        r[EMU_PSW] = (r[EMU_PSW] & ~(PSW_Z | PSW_N)) | (value == 0 ? PSW_Z : 0) | (value & 0x8000 ? PSW_N : 0);
+        return true;
+    case H_SHL:
+        carry = count != 0 && count <= 16 && ((a >> (16 - count)) & 1);
+        a = count < 16 ? a << count : 0;
+        r[EMU_PSW] = (r[EMU_PSW] & ~(PSW_Z | PSW_C | PSW_N)) |
+                     (a == 0 ? PSW_Z : 0) | (carry ? PSW_C : 0) | (a & 0x8000 ? PSW_N : 0);
+        return true;
+    case H_SHR:
+        carry = count != 0 && count <= 16 && ((a >> (count - 1)) & 1);
+        a = count < 16 ? a >> count : 0;
+        r[EMU_PSW] = (r[EMU_PSW] & ~(PSW_Z | PSW_C | PSW_N)) |
+                     (a == 0 ? PSW_Z : 0) | (carry ? PSW_C : 0) | (a & 0x8000 ? PSW_N : 0);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Any ldr or str, register update 1 and 2 is done before access, 3 and 4 after it
+inline void Emulator::transfer(const Decoded &entry)
+{
+    bool load = entry.opcode == 0xA0;
+    unsigned short &base = r[entry.s];
+    unsigned short value = r[entry.d];
+    if (entry.update == 1)
+        base -= 2;
+    else if (entry.update == 2)
+        base += 2;
+
+    if (entry.mode == 0)
+        value = entry.payload;
+    else if (entry.mode == 1 && load)
+        value = base;
+    else if (entry.mode == 1)
+        base = value;
+    else if (load)
+        value = read_word(entry.mode == 4 ? entry.payload : base + entry.payload);
+    else
+        write_word(entry.mode == 4 ? entry.payload : base + entry.payload, value);
+
+    if (entry.update == 3)
+        base -= 2;
+    else if (entry.update == 4)
+        base += 2;
+    if (load)
+        r[entry.d] = value;
+}
+
+bool Emulator::execute(const Decoded &entry)
+{
+    unsigned short value;
+    switch (entry.id)
+    {
+    case H_XCHG:
+        value = r[entry.d];
+        r[entry.d] = r[entry.s];
+        r[entry.s] = value;
+        return true;
+    case H_LDR_IMM:
+    case H_LDR_REG:
+    case H_LDR_IND:
+    case H_LDR_MEM:
+    case H_LDR:
+    case H_STR_REG:
+    case H_STR_IND:
+    case H_STR_MEM:
+    case H_STR:
+    case H_PUSH:
+    case H_POP:
+        transfer(entry);
+        return true;
+    default:
+        return alu(entry.id, r[entry.d], r[entry.s]);
+    }
+}
+
+Handler_id Emulator::decode(unsigned short address, Decoded &entry)
+{
+    const unsigned char *bytes = &memory[address];
+    entry.opcode = bytes[0];
+    entry.d = bytes[1] >> 4;
+    entry.s = bytes[1] & 0xF;
+    entry.update = bytes[2] >> 4;
+    entry.mode = bytes[2] & 0xF;
+    entry.payload = bytes[3] | (bytes[4] << 8);
+    entry.size = 1;
+
+    bool payload = entry.mode == 0 || entry.mode == 3 || entry.mode == 4 || entry.mode == 5;
+    bool d_valid = entry.d <= EMU_PSW;
+    bool s_valid = entry.s <= EMU_PSW;
+    bool load = entry.opcode == 0xA0;
+    Handler_id id = H_INVALID;
+    switch (entry.opcode)
+    {
+    case 0x00:
+        id = H_HALT;
+        break;
+    case 0x20:
+        id = H_IRET;
+        break;
+    case 0x40:
+        id = H_RET;
+        break;
+    case 0x10:
+    case 0x80:
+        entry.size = 2;
+        entry.s = 0;
+        if (d_valid)
+            id = entry.opcode == 0x10 ? H_INT : H_NOT;
+        break;
+    case 0x60:
+    case 0x70:
+    case 0x71:
+    case 0x72:
+    case 0x73:
+    case 0x74:
+    case 0x81:
+    case 0x82:
+    case 0x83:
+    case 0x84:
+    case 0x90:
+    case 0x91:
+    {
+        static const Handler_id alu_ids[3][5] = {
+            {H_ADD, H_SUB, H_MUL, H_DIV, H_CMP},
+            {H_AND, H_OR, H_XOR, H_TEST, H_INVALID},
+            {H_SHL, H_SHR, H_INVALID, H_INVALID, H_INVALID},
+        };
+        entry.size = 2;
+        if (d_valid && s_valid)
+            id = entry.opcode == 0x60 ? H_XCHG : alu_ids[(entry.opcode >> 4) - 7][(entry.opcode & 0xF) - (entry.opcode >> 4 == 8 ? 1 : 0)];
+        break;
+    }
+    case 0x30:
+    case 0x50:
+    case 0x51:
+    case 0x52:
+    case 0x53:
+    {
+        static const Handler_id direct[4] = {H_JMP_DIRECT, H_JEQ_DIRECT, H_JNE_DIRECT, H_JGT_DIRECT};
+        if (entry.mode > 5 || entry.update != 0)
+            break;
+        entry.size = 3 + (payload ? 2 : 0);
+        if (entry.mode != 0 && entry.mode != 4 && !s_valid)
+            break;
+        // Targets that do not depend on registers are known now, pc relative ones included
+        if (entry.mode == 0 || (entry.mode == 5 && entry.s == EMU_PC))
+        {
+            if (entry.mode == 5)
+                entry.payload += address + entry.size;
+            id = entry.opcode == 0x30 ? H_CALL_DIRECT : direct[entry.opcode & 0xF];
+        }
+        else
+            id = H_JUMP;
+        break;
+    }
+    case 0xA0:
+    case 0xB0:
+        // push and pop are encoded with register direct mode and an update, which only means
+        // something for memory, so they go through the register like register indirect
+        if (entry.update != 0 && entry.mode == 1)
+            entry.mode = 2;
+        if (entry.mode > 4 || entry.update > 4 || (!load && entry.mode == 0) ||
+            (entry.update != 0 && entry.mode != 2 && entry.mode != 3))
+            break;
+        entry.size = 3 + (payload ? 2 : 0);
+        if (!d_valid || (entry.mode >= 1 && entry.mode <= 3 && !s_valid))
+            break;
+        if (entry.mode == 2)
+            entry.payload = 0;
+
+        // pc is known while decoding, so pc relative data is at a fixed address
+        if (entry.update == 0 && entry.s == EMU_PC && entry.mode == 3)
+        {
+            entry.payload += address + entry.size;
+            entry.mode = 4;
+        }
+
+        if (entry.update != 0)
+        {
+            if (entry.s == EMU_SP && entry.mode == 2 && entry.update == (load ? 4 : 1))
+                id = load ? H_POP : H_PUSH;
+            else
+                id = load ? H_LDR : H_STR;
+        }
+        else if (entry.mode == 0)
+            id = H_LDR_IMM;
+        else if (entry.mode == 1)
+            id = load ? H_LDR_REG : H_STR_REG;
+        else if (entry.mode == 4)
+            id = load ? H_LDR_MEM : H_STR_MEM;
+        else
+            id = load ? H_LDR_IND : H_STR_IND;
+        break;
+    default:
+        break;
+    }
+
+    // Code can not run from memory mapped registers
+    if (address + entry.size > MMIO_START)
+    {
+        entry.size = 1;
+        id = H_INVALID;
+    }
+    for (unsigned int i = 0; i < entry.size; i++)
+        code[address + i] = 1;
+
+    entry.id = id;
+    bool uses_pc = false;
+    if (id >= H_XCHG && id <= H_SHR)
+        uses_pc = entry.d == EMU_PC || entry.s == EMU_PC;
+    else if (id >= H_LDR_IMM && id <= H_POP)
+        uses_pc = entry.d == EMU_PC || (entry.mode >= 1 && entry.mode <= 3 && entry.s == EMU_PC);
+    return uses_pc ? H_SLOW : id;
+}
+
+bool Emulator::run()
+{
+    // Same order as Handler_id
+    static const void *const labels[H_COUNT] = {
+        &&op_decode, &&op_invalid, &&op_halt, &&op_int, &&op_iret, &&op_ret,
+        &&op_call_direct, &&op_jmp_direct, &&op_jeq_direct, &&op_jne_direct, &&op_jgt_direct, &&op_jump,
+        &&op_xchg, &&op_add, &&op_sub, &&op_mul, &&op_div, &&op_cmp,
+        &&op_not, &&op_and, &&op_or, &&op_xor, &&op_test, &&op_shl, &&op_shr,
+        &&op_ldr_imm, &&op_ldr_reg, &&op_ldr_ind, &&op_ldr_mem, &&op_ldr,
+        &&op_str_reg, &&op_str_ind, &&op_str_mem, &&op_str, &&op_push, &&op_pop, &&op_slow};
+
+    decode_handler = labels[H_DECODE];
+    for (unsigned int i = 0; i < MEMORY_SIZE; i++)
+    {
+        cache[i].handler = decode_handler;
+        cache[i].size = 0;
+    }
+
+    if (options.jit && jit == NULL)
+    {
+        jit = new Jit(*this);
+        if (!jit->is_available())
+        {
+            diagnostics << jit->get_diagnostics();
+            delete jit;
+            jit = NULL;
+        }
+    }
+
+    start_terminal();
+    r[EMU_SP] = MMIO_START;
+    r[EMU_PSW] = 0;
+    next_tick = std::chrono::steady_clock::now() + std::chrono::milliseconds(timer_periods[tim_cfg & 7]);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned long long count = 0;
+    unsigned long long device_poll_at = POLL_INTERVAL;
+    unsigned long long poll_at = jit == NULL ? device_poll_at : 0;
+    bool no_errors = true;
+    Decoded *entries = cache.data();
+    Decoded *d = NULL;
+    unsigned short pc = read_word(IVT_RESET * 2);
+    unsigned short value;
+
+    // pc is the address of the running instruction. Handlers advance it by their size, which
+    // is a constant for most of them, so the next address does not wait for a load.
+    // Straight line code only counts, devices are polled on jumps, which every loop takes
+#define NEXT(size)                 \
+    do                             \
+    {                              \
+        pc += size;                \
+        d = &entries[pc];          \
+        count++;                   \
+        goto *d->handler;          \
+    } while (0)
+#define JUMP(size)                 \
+    do                             \
+    {                              \
+        if (count >= poll_at)      \
+        {                          \
+            pc += size;            \
+            goto poll;             \
+        }                          \
+        NEXT(size);                \
+    } while (0)
+#define ALU(id)                                \
+    do                                         \
+    {                                          \
+        if (!alu(id, r[d->d], r[d->s]))        \
+            goto op_invalid;                   \
+        NEXT(2);                               \
+    } while (0)
+
+    NEXT(0);
+
+poll:
+    if (count >= device_poll_at)
+    {
+        device_poll_at = count + POLL_INTERVAL;
+        r[EMU_PC] = pc;
+        poll_devices();
+        pc = r[EMU_PC];
+    }
+    if (jit == NULL)
+    {
+        poll_at = device_poll_at;
+        NEXT(0);
+    }
+
+    // Translated blocks chain into each other until they reach code that is not translated,
+    // an instruction they leave to the interpreter, or the next device poll
+    while (count < device_poll_at)
+    {
+        const void *block = jit->block(pc);
+        if (block == NULL)
+            break;
+        Jit_result result = jit->enter(block, device_poll_at - count);
+        count = device_poll_at - result.budget;
+        pc = result.pc & 0xFFFF;
+        if ((result.pc >> 16) != JIT_EXIT_JUMP)
+            break;
+    }
+    NEXT(0);
+
+op_decode:
+    cache[pc].handler = labels[decode(pc, cache[pc])];
+    goto *d->handler;
+
+op_invalid:
+    // Error handler gets the address after the invalid instruction
+    if (read_word(IVT_ERROR * 2) == 0)
+    {
+        diagnostics << "Error: invalid instruction at 0x" << std::hex << std::setw(4) << std::setfill('0')
+                    << pc << std::dec << std::endl;
+        no_errors = false;
+        goto done;
+    }
+    r[EMU_PC] = pc + d->size;
+    interrupt(IVT_ERROR);
+    pc = r[EMU_PC];
+    JUMP(0);
+
+op_halt:
+    pc += 1;
+    goto done;
+
+op_int:
+    r[EMU_PC] = pc + 2;
+    interrupt(r[d->d] & 7);
+    pc = r[EMU_PC];
+    JUMP(0);
+
+op_iret:
+    r[EMU_PSW] = pop();
+    pc = pop();
+    JUMP(0);
+
+op_ret:
+    pc = pop();
+    JUMP(0);
+
+// Direct jumps always carry a payload
+op_call_direct:
+    push(pc + 5);
+    pc = d->payload;
+    JUMP(0);
+
+op_jmp_direct:
+    pc = d->payload;
+    JUMP(0);
+
+op_jeq_direct:
+    pc = (r[EMU_PSW] & PSW_Z) ? d->payload : pc + 5;
+    JUMP(0);
+
+op_jne_direct:
+    pc = !(r[EMU_PSW] & PSW_Z) ? d->payload : pc + 5;
+    JUMP(0);
+
+op_jgt_direct:
+    pc = !(r[EMU_PSW] & PSW_Z) && !(r[EMU_PSW] & PSW_N) == !(r[EMU_PSW] & PSW_O) ? d->payload : pc + 5;
+    JUMP(0);
+
+op_jump:
+{
+    pc += d->size;
+    r[EMU_PC] = pc;
+    switch (d->mode)
+    {
+    case 1:
+        value = r[d->s];
+        break;
+    case 2:
+        value = read_word(r[d->s]);
+        break;
+    case 3:
+        value = read_word(r[d->s] + d->payload);
+        break;
+    case 4:
+        value = read_word(d->payload);
+        break;
+    default:
+        value = r[d->s] + d->payload;
+        break;
+    }
+    bool taken = true;
+    if (d->opcode == 0x51)
+        taken = r[EMU_PSW] & PSW_Z;
+    else if (d->opcode == 0x52)
+        taken = !(r[EMU_PSW] & PSW_Z);
+    else if (d->opcode == 0x53)
+        taken = !(r[EMU_PSW] & PSW_Z) && !(r[EMU_PSW] & PSW_N) == !(r[EMU_PSW] & PSW_O);
+    else if (d->opcode == 0x30)
+        push(pc);
+    if (taken)
+        pc = value;
+    JUMP(0);
+}
+
+op_xchg:
+    value = r[d->d];
+    r[d->d] = r[d->s];
+    r[d->s] = value;
+    NEXT(2);
+
+op_add:
+    ALU(H_ADD);
+op_sub:
+    ALU(H_SUB);
+op_mul:
+    ALU(H_MUL);
+op_div:
+    ALU(H_DIV);
+op_cmp:
+    ALU(H_CMP);
+op_not:
+    ALU(H_NOT);
+op_and:
+    ALU(H_AND);
+op_or:
+    ALU(H_OR);
+op_xor:
+    ALU(H_XOR);
+op_test:
+    ALU(H_TEST);
+op_shl:
+    ALU(H_SHL);
+op_shr:
+    ALU(H_SHR);
+
+op_ldr_imm:
+    r[d->d] = d->payload;
+    NEXT(5);
+
+op_ldr_reg:
+    r[d->d] = r[d->s];
+    NEXT(3);
+
+op_ldr_ind:
+    r[d->d] = read_word(r[d->s] + d->payload);
+    NEXT(d->size);
+
+op_ldr_mem:
+    r[d->d] = read_word(d->payload);
+    NEXT(5);
+
+op_ldr:
+    transfer(*d);
+    NEXT(d->size);
+
+op_str_reg:
+    r[d->s] = r[d->d];
+    NEXT(3);
+
+op_str_ind:
+    write_word(r[d->s] + d->payload, r[d->d]);
+    NEXT(d->size);
+
+op_str_mem:
+    write_word(d->payload, r[d->d]);
+    NEXT(5);
+
+op_str:
+    transfer(*d);
+    NEXT(d->size);
+
+op_push:
+    push(r[d->d]);
+    NEXT(3);
+
+op_pop:
+    r[d->d] = pop();
+    NEXT(3);
+
+op_slow:
+    r[EMU_PC] = pc + d->size;
+    if (!execute(*d))
+        goto op_invalid;
+    pc = r[EMU_PC];
+    JUMP(0);
+
+done:
+#undef NEXT
+#undef JUMP
+#undef ALU
+    r[EMU_PC] = pc;
+    executed = count;
+    std::fflush(stdout);
+    stop_terminal();
+
+    if (options.stats)
+    {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        diagnostics << "Executed " << executed << " instructions in " << std::fixed << std::setprecision(3)
+                    << seconds << " s, " << std::setprecision(1) << (seconds > 0 ? executed / seconds / 1e6 : 0)
+                    << " MIPS" << std::endl;
+    }
+    return no_errors;
+}
+
+std::string Emulator::write_state()
+{
+    std::stringstream text;
+    text << "-----------------------------------------------------------------" << std::endl;
+    text << "Emulated processor executed halt instruction" << std::endl;
+    text << "Emulated processor state: psw=0b";
+    for (int bit = 15; bit >= 0; bit--)
+        text << ((r[EMU_PSW] >> bit) & 1);
+    text << std::endl
+         << std::hex << std::setfill('0');
+    for (unsigned int i = 0; i < 8; i++)
+        text << "r" << i << "=0x" << std::setw(4) << r[i] << (i % 4 == 3 ? "\n" : "    ");
+    return text.str();
+}
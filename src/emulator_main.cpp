@@ -0,0 +1,58 @@
+#include <iostream>
+#include <string>
+
+#include "../inc/emulator.hpp"
+
+static void print_usage()
+{
+    std::cout << "Usage: emulator [--stats] [--jit] memory_image" << std::endl;
+    std::cout << "  --stats             print executed instructions and speed" << std::endl;
+    std::cout << "  --jit               translate hot blocks to x86-64 code" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string ImageName;
+    Emulator_options options;
+
+    // Command: emulator program.img
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--stats")
+        {
+            options.stats = true;
+        }
+        else if (arg == "--jit")
+        {
+            options.jit = true;
+        }
+        else if (arg[0] == '-' || !ImageName.empty())
+        {
+            print_usage();
+            return 1;
+        }
+        else
+        {
+            ImageName = arg;
+        }
+    }
+
+    if (ImageName.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    Emulator emulator(options);
+    if (!emulator.load(ImageName))
+    {
+        std::cout << emulator.get_diagnostics();
+        return 1;
+    }
+    bool no_errors = emulator.run();
+    std::cout << std::endl
+              << emulator.write_state() << emulator.get_diagnostics();
+    return no_errors ? 0 : 1;
+}
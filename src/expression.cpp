@@ -0,0 +1,415 @@
+#include "../inc/expression.hpp"
+#include "../inc/lexer.hpp"
+
+static inline bool is_symbol_start(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '.';
+}
+
+static inline bool is_symbol_char(char c)
+{
+    return is_symbol_start(c) || (c >= '0' && c <= '9');
+}
+
+Expression_Parser::Expression_Parser(Symbol_Table *symbols, std::ostream &diagnostics)
+    : symbols(symbols), diagnostics(diagnostics)
+{
+    this->position = 0;
+}
+
+bool Expression_Parser::parse(std::string_view text, Expression &result)
+{
+    this->text = text;
+    this->position = 0;
+    result = Expression();
+    if (!parse_or(result))
+        return false;
+    skip_spaces();
+    if (position != text.length())
+    {
+        diagnostics << "Error: unexpected " << text.substr(position) << " in expression " << text << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Expression_Parser::skip_spaces()
+{
+    while (position < text.length() && (text[position] == ' ' || text[position] == '\t' || text[position] == '\r'))
+        position++;
+}
+
+bool Expression_Parser::accept(const char *operation)
+{
+    skip_spaces();
+    std::string_view op(operation);
+    if (text.substr(position, op.length()) != op)
+        return false;
+    position += op.length();
+    return true;
+}
+
+bool Expression_Parser::require_absolute(Expression &value, const char *operation)
+{
+    // Values of .equ symbols and differences of labels in one section are known,
+    // anything else can only be added or subtracted
+    Expression reduced = value;
+    if (reduce_expression(reduced, false) && reduced.terms.empty())
+    {
+        value = reduced;
+        return true;
+    }
+
+    std::vector<Expression_term> undefined;
+    for (std::vector<Expression_term>::iterator it = value.terms.begin(); it != value.terms.end(); ++it)
+    {
+        if (it->kind == TERM_UNDEFINED)
+            undefined.push_back(*it);
+    }
+    if (undefined.empty())
+    {
+        for (std::vector<Expression_term>::iterator it = value.terms.begin(); it != value.terms.end(); ++it)
+        {
+            if (it->kind != TERM_ABSOLUTE)
+            {
+                diagnostics << "Error: symbol " << it->name << " can not be used with operator " << operation << std::endl;
+                return false;
+            }
+        }
+    }
+    // Undefined symbols are reported by caller, or expression is only checked for syntax
+    for (std::vector<Expression_term>::iterator it = undefined.begin(); it != undefined.end(); ++it)
+        it->folded = true;
+    value.terms.swap(undefined);
+    return true;
+}
+
+static bool check_overflow(long long value, std::ostream &diagnostics, std::string_view text)
+{
+    if (value > 0x7FFFFFFFLL || value < -0x80000000LL)
+    {
+        diagnostics << "Error: expression " << text << " overflows" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Expression_Parser::parse_or(Expression &result)
+{
+    if (!parse_xor(result))
+        return false;
+    while (accept("|"))
+    {
+        Expression right;
+        if (!parse_xor(right) || !require_absolute(result, "|") || !require_absolute(right, "|"))
+            return false;
+        result.constant |= right.constant;
+        result.terms.insert(result.terms.end(), right.terms.begin(), right.terms.end());
+    }
+    return true;
+}
+
+bool Expression_Parser::parse_xor(Expression &result)
+{
+    if (!parse_and(result))
+        return false;
+    while (accept("^"))
+    {
+        Expression right;
+        if (!parse_and(right) || !require_absolute(result, "^") || !require_absolute(right, "^"))
+            return false;
+        result.constant ^= right.constant;
+        result.terms.insert(result.terms.end(), right.terms.begin(), right.terms.end());
+    }
+    return true;
+}
+
+bool Expression_Parser::parse_and(Expression &result)
+{
+    if (!parse_shift(result))
+        return false;
+    while (accept("&"))
+    {
+        Expression right;
+        if (!parse_shift(right) || !require_absolute(result, "&") || !require_absolute(right, "&"))
+            return false;
+        result.constant &= right.constant;
+        result.terms.insert(result.terms.end(), right.terms.begin(), right.terms.end());
+    }
+    return true;
+}
+
+bool Expression_Parser::parse_shift(Expression &result)
+{
+    if (!parse_additive(result))
+        return false;
+    while (true)
+    {
+        bool left = accept("<<");
+        if (!left && !accept(">>"))
+            return true;
+
+        const char *operation = left ? "<<" : ">>";
+        Expression right;
+        if (!parse_additive(right) || !require_absolute(result, operation) || !require_absolute(right, operation))
+            return false;
+        if (!right.terms.empty() || !result.terms.empty())
+        {
+            result.terms.insert(result.terms.end(), right.terms.begin(), right.terms.end());
+            continue;
+        }
+        if (right.constant < 0 || right.constant > 31)
+        {
+            diagnostics << "Error: shift count " << right.constant << " out of range in expression " << text << std::endl;
+            return false;
+        }
+        result.constant = left ? result.constant * (1LL << right.constant) : result.constant >> right.constant;
+        if (!check_overflow(result.constant, diagnostics, text))
+            return false;
+    }
+}
+
+bool Expression_Parser::parse_additive(Expression &result)
+{
+    if (!parse_multiplicative(result))
+        return false;
+    while (true)
+    {
+        bool add = accept("+");
+        if (!add && !accept("-"))
+            return true;
+
+        Expression right;
+        if (!parse_multiplicative(right))
+            return false;
+        for (std::vector<Expression_term>::iterator it = right.terms.begin(); it != right.terms.end(); ++it)
+        {
+            it->coefficient = add ? it->coefficient : -it->coefficient;
+            result.terms.push_back(*it);
+        }
+        result.constant += add ? right.constant : -right.constant;
+        if (!check_overflow(result.constant, diagnostics, text))
+            return false;
+    }
+}
+
+bool Expression_Parser::parse_multiplicative(Expression &result)
+{
+    if (!parse_unary(result))
+        return false;
+    while (true)
+    {
+        bool multiply = accept("*");
+        if (!multiply && !accept("/"))
+            return true;
+
+        const char *operation = multiply ? "*" : "/";
+        Expression right;
+        if (!parse_unary(right) || !require_absolute(result, operation) || !require_absolute(right, operation))
+            return false;
+        if (!right.terms.empty() || !result.terms.empty())
+        {
+            result.terms.insert(result.terms.end(), right.terms.begin(), right.terms.end());
+            continue;
+        }
+        if (!multiply && right.constant == 0)
+        {
+            diagnostics << "Error: division by zero in expression " << text << std::endl;
+            return false;
+        }
+        result.constant = multiply ? result.constant * right.constant : result.constant / right.constant;
+        if (!check_overflow(result.constant, diagnostics, text))
+            return false;
+    }
+}
+
+bool Expression_Parser::parse_unary(Expression &result)
+{
+    if (accept("-"))
+    {
+        if (!parse_unary(result))
+            return false;
+        result.constant = -result.constant;
+        for (std::vector<Expression_term>::iterator it = result.terms.begin(); it != result.terms.end(); ++it)
+            it->coefficient = -it->coefficient;
+        return true;
+    }
+    if (accept("+"))
+        return parse_unary(result);
+    if (accept("~"))
+    {
+        if (!parse_unary(result) || !require_absolute(result, "~"))
+            return false;
+        result.constant = ~result.constant;
+        return true;
+    }
+    return parse_primary(result);
+}
+
+bool Expression_Parser::parse_primary(Expression &result)
+{
+    skip_spaces();
+    if (position == text.length())
+    {
+        diagnostics << "Error: unexpected end of expression " << text << std::endl;
+        return false;
+    }
+
+    if (accept("("))
+    {
+        if (!parse_or(result))
+            return false;
+        if (!accept(")"))
+        {
+            diagnostics << "Error: missing ) in expression " << text << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    std::size_t start = position;
+    char c = text[position];
+    if (c == '\'')
+    {
+        // Character literal, escaped quote does not end it
+        position++;
+        while (position < text.length() && text[position] != '\'')
+            position += text[position] == '\\' ? 2 : 1;
+        position = std::min(position + 1, text.length());
+    }
+    else if (c >= '0' && c <= '9')
+    {
+        while (position < text.length() && is_symbol_char(text[position]))
+            position++;
+    }
+    else if (is_symbol_start(c))
+    {
+        while (position < text.length() && is_symbol_char(text[position]))
+            position++;
+        return parse_symbol(text.substr(start, position - start), result);
+    }
+    else
+    {
+        diagnostics << "Error: unexpected " << text.substr(position) << " in expression " << text << std::endl;
+        return false;
+    }
+
+    std::string_view literal = text.substr(start, position - start);
+    unsigned int value;
+    switch (parse_literal(literal, value))
+    {
+    case LITERAL_OK:
+        result.constant = value;
+        return true;
+    case LITERAL_OUT_OF_RANGE:
+        diagnostics << "Error: literal " << literal << " does not fit in 16 bits" << std::endl;
+        return false;
+    default:
+        diagnostics << "Error: invalid literal " << literal << std::endl;
+        return false;
+    }
+}
+
+bool Expression_Parser::parse_symbol(std::string_view name, Expression &result)
+{
+    Expression_term term;
+    term.kind = TERM_UNDEFINED;
+    term.name = name;
+    term.symbol = 0;
+    term.section = Section_Table::UND;
+    term.value = 0;
+    term.coefficient = 1;
+    term.folded = false;
+
+    Symbol_handle smb = symbols != NULL ? symbols->find_symbol(name) : Symbol_handle{0, NULL};
+    if (smb.record != NULL)
+    {
+        term.symbol = smb.id;
+        term.section = smb.record->section;
+        if (smb.record->section == Section_Table::UND)
+        {
+            term.kind = TERM_EXTERN;
+        }
+        else if (smb.record->section == Section_Table::ABSOLUTE)
+        {
+            term.kind = TERM_ABSOLUTE;
+            term.value = smb.record->offset;
+        }
+        else
+        {
+            term.kind = TERM_LABEL;
+            term.value = smb.record->offset;
+        }
+    }
+    result.terms.push_back(term);
+    return true;
+}
+
+bool reduce_expression(Expression &expr, bool pc_relative)
+{
+    bool relocatable = false;
+    for (std::vector<Expression_term>::iterator it = expr.terms.begin(); it != expr.terms.end(); ++it)
+        relocatable = relocatable || it->kind != TERM_ABSOLUTE;
+
+    // Net coefficient per section for labels, and per symbol for anything else
+    std::vector<Expression_term> groups;
+    for (std::vector<Expression_term>::iterator it = expr.terms.begin(); it != expr.terms.end(); ++it)
+    {
+        if (it->kind == TERM_ABSOLUTE && (relocatable || !pc_relative))
+        {
+            expr.constant += it->coefficient * it->value;
+            continue;
+        }
+        if (it->kind == TERM_LABEL)
+            expr.constant += it->coefficient * it->value;
+
+        std::vector<Expression_term>::iterator group = groups.begin();
+        for (; group != groups.end(); ++group)
+        {
+            if (group->kind == it->kind &&
+                (it->kind == TERM_LABEL ? group->section == it->section : equal_ignore_case(group->name, it->name)))
+                break;
+        }
+        if (group == groups.end())
+        {
+            groups.push_back(*it);
+            continue;
+        }
+        int coefficient = group->coefficient + it->coefficient;
+        // Label that is added is the one relocation will refer to
+        if (it->coefficient == 1)
+            *group = *it;
+        group->coefficient = coefficient;
+    }
+
+    expr.terms.clear();
+    for (std::vector<Expression_term>::iterator group = groups.begin(); group != groups.end(); ++group)
+    {
+        if (group->coefficient != 0)
+            expr.terms.push_back(*group);
+    }
+    if (expr.terms.empty())
+        return true;
+    if (expr.terms.size() > 1 || expr.terms[0].coefficient != 1)
+        return false;
+    if (expr.terms[0].kind == TERM_LABEL)
+        expr.constant -= expr.terms[0].value;
+    return true;
+}
+
+bool is_symbol_name(std::string_view text)
+{
+    if (text.empty() || !is_symbol_start(text[0]))
+        return false;
+    for (std::size_t i = 1; i < text.length(); i++)
+    {
+        if (!is_symbol_char(text[i]))
+            return false;
+    }
+    return true;
+}
+
+bool fits_16_bits(long long value)
+{
+    return value >= -32768 && value <= 65535;
+}
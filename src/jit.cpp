@@ -0,0 +1,710 @@
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../inc/jit.hpp"
+#include "../inc/emulator.hpp"
+
+// Host registers by encoding number
+typedef enum
+{
+    RAX = 0,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+} Host_register;
+
+// Conditions of jcc
+typedef enum
+{
+    CC_AE = 0x3,
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_L = 0xC,
+    CC_GE = 0xD,
+    CC_G = 0xF,
+} Host_condition;
+
+// Host register of every register nibble, pc is never kept in one. Nibbles above psw are
+// fill or unused operands, handlers that would use them are not translated
+static const unsigned int NO_HOST = 0xFF;
+static const unsigned int host[EMU_REGISTERS] = {RBX, RBP, R12, R13, R14, R15, R8, RAX, R9,
+                                                 NO_HOST, NO_HOST, NO_HOST, NO_HOST, NO_HOST, NO_HOST, NO_HOST};
+
+static bool is_straight(Handler_id id)
+{
+    switch (id)
+    {
+    case H_XCHG:
+    case H_ADD:
+    case H_SUB:
+    case H_MUL:
+    case H_CMP:
+    case H_NOT:
+    case H_AND:
+    case H_OR:
+    case H_XOR:
+    case H_TEST:
+    case H_LDR_IMM:
+    case H_LDR_REG:
+    case H_LDR_IND:
+    case H_LDR_MEM:
+    case H_STR_REG:
+    case H_STR_IND:
+    case H_STR_MEM:
+    case H_PUSH:
+    case H_POP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_memory(Handler_id id)
+{
+    return id == H_LDR_IND || id == H_LDR_MEM || id == H_STR_IND || id == H_STR_MEM || id == H_PUSH || id == H_POP;
+}
+
+static bool is_branch(Handler_id id)
+{
+    return id == H_RET || id == H_CALL_DIRECT || id == H_JMP_DIRECT || id == H_JEQ_DIRECT ||
+           id == H_JNE_DIRECT || id == H_JGT_DIRECT;
+}
+
+Jit::Jit(Emulator &emulator)
+    : emulator(emulator), blocks(MEMORY_SIZE, NULL), heat(MEMORY_SIZE, 0), waiting(MEMORY_SIZE)
+{
+    buffer = NULL;
+    used = 0;
+    epilogue = 0;
+    code_start = 0;
+    perf_map = NULL;
+    writable = true;
+#if defined(__x86_64__)
+    // Writable while code is emitted, executable while it runs, never both
+    void *memory = mmap(NULL, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED)
+        buffer = static_cast<unsigned char *>(memory);
+#endif
+    if (buffer == NULL)
+    {
+        diagnostics << "Warning: translation to host code is not available, interpreting" << std::endl;
+        return;
+    }
+
+    // Trampoline(registers = rdi, memory = rsi, budget = rdx, block = rcx, code = r8) saves
+    // callee saved registers, loads guest registers and jumps to the block
+    static const unsigned char enter_code[] = {
+        0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, // push rbx, rbp, r12 - r15
+        0x49, 0x89, 0xD3,                                           // mov r11, rdx
+        0x4D, 0x89, 0xC2,                                           // mov r10, r8
+    };
+    for (unsigned char byte : enter_code)
+        emit8(byte);
+    for (unsigned int i = 0; i <= EMU_PSW; i++)
+    {
+        if (i == EMU_PC)
+            continue;
+        // movzx host, word [rdi + 2 * i]
+        rex(host[i], RDI);
+        emit8(0x0F);
+        emit8(0xB7);
+        emit8(0x40 | (host[i] & 7) << 3 | RDI);
+        emit8(i * 2);
+    }
+    emit8(0xFF); // jmp rcx
+    emit8(0xE1);
+
+    // Epilogue, eax holds pc and exit kind, budget that is left goes to rdx
+    epilogue = used;
+    for (unsigned int i = 0; i <= EMU_PSW; i++)
+    {
+        if (i == EMU_PC)
+            continue;
+        // mov word [rdi + 2 * i], host
+        emit8(0x66);
+        rex(host[i], RDI);
+        emit8(0x89);
+        emit8(0x40 | (host[i] & 7) << 3 | RDI);
+        emit8(i * 2);
+    }
+    static const unsigned char leave_code[] = {
+        0x4C, 0x89, 0xDA,                                           // mov rdx, r11
+        0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, // pop r15 - r12, rbp, rbx
+        0xC3,                                                       // ret
+    };
+    for (unsigned char byte : leave_code)
+        emit8(byte);
+    code_start = used;
+    open_perf_map();
+}
+
+// perf reads symbols of code generated at run time from this file, it is started again when
+// code is flushed so that no stale addresses stay in it
+void Jit::open_perf_map()
+{
+    if (perf_map != NULL)
+        std::fclose(perf_map);
+    std::string name = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+    perf_map = std::fopen(name.c_str(), "w");
+    if (perf_map != NULL)
+        std::fprintf(perf_map, "%lx %zx guest_trampoline\n", reinterpret_cast<unsigned long>(buffer), code_start);
+}
+
+void Jit::protect(bool write)
+{
+    if (write == writable)
+        return;
+    if (mprotect(buffer, BUFFER_SIZE, write ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0)
+        writable = write;
+}
+
+Jit::~Jit()
+{
+    if (perf_map != NULL)
+        std::fclose(perf_map);
+    if (buffer != NULL)
+        munmap(buffer, BUFFER_SIZE);
+}
+
+bool Jit::is_available()
+{
+    return buffer != NULL;
+}
+
+std::string Jit::get_diagnostics()
+{
+    return diagnostics.str();
+}
+
+const void *Jit::block(unsigned short pc)
+{
+    if (blocks[pc] != NULL || buffer == NULL)
+        return blocks[pc];
+    if (heat[pc] == NOT_TRANSLATABLE || ++heat[pc] < HOT_THRESHOLD)
+        return NULL;
+    return translate(pc);
+}
+
+Jit_result Jit::enter(const void *block, long long budget)
+{
+    protect(false);
+    Jit_trampoline trampoline = reinterpret_cast<Jit_trampoline>(buffer);
+    return trampoline(emulator.r, emulator.memory.data(), budget, block, emulator.code.data());
+}
+
+void Jit::flush()
+{
+    used = code_start;
+    std::fill(blocks.begin(), blocks.end(), static_cast<const void *>(NULL));
+    std::fill(heat.begin(), heat.end(), 0);
+    for (std::vector<std::size_t> &sites : waiting)
+        sites.clear();
+    open_perf_map();
+}
+
+/* ----- Encoding ----- */
+
+inline void Jit::emit8(unsigned char byte)
+{
+    buffer[used++] = byte;
+}
+
+inline void Jit::emit16(unsigned short value)
+{
+    emit8(value & 0xFF);
+    emit8(value >> 8);
+}
+
+inline void Jit::emit32(unsigned int value)
+{
+    emit16(value & 0xFFFF);
+    emit16(value >> 16);
+}
+
+// Prefix for registers r8 - r15 in reg and base (or r/m) fields
+void Jit::rex(unsigned int reg, unsigned int base)
+{
+    if (reg >= R8 || base >= R8)
+        emit8(0x40 | (reg >= R8 ? 4 : 0) | (base >= R8 ? 1 : 0));
+}
+
+// 16 bit operation with dest in r/m and source in reg field
+void Jit::op16_rr(unsigned char opcode, unsigned int dest, unsigned int source)
+{
+    emit8(0x66);
+    rex(source, dest);
+    emit8(opcode);
+    emit8(0xC0 | (source & 7) << 3 | (dest & 7));
+}
+
+void Jit::mov32_rr(unsigned int dest, unsigned int source)
+{
+    rex(source, dest);
+    emit8(0x89);
+    emit8(0xC0 | (source & 7) << 3 | (dest & 7));
+}
+
+void Jit::movzx_rr(unsigned int dest, unsigned int source)
+{
+    rex(dest, source);
+    emit8(0x0F);
+    emit8(0xB7);
+    emit8(0xC0 | (dest & 7) << 3 | (source & 7));
+}
+
+void Jit::mov16_ri(unsigned int dest, unsigned short value)
+{
+    emit8(0x66);
+    rex(0, dest);
+    emit8(0xB8 | (dest & 7));
+    emit16(value);
+}
+
+// movzx dest, word [rsi + rax]
+void Jit::movzx_load(unsigned int dest)
+{
+    rex(dest, 0);
+    emit8(0x0F);
+    emit8(0xB7);
+    emit8(0x04 | (dest & 7) << 3);
+    emit8(0x06);
+}
+
+// mov word [rsi + rax], source
+void Jit::mov16_store(unsigned int source)
+{
+    emit8(0x66);
+    rex(source, 0);
+    emit8(0x89);
+    emit8(0x04 | (source & 7) << 3);
+    emit8(0x06);
+}
+
+// Jumps return the offset of their rel32, patched once the destination is known
+std::size_t Jit::jcc(unsigned char condition)
+{
+    emit8(0x0F);
+    emit8(0x80 | condition);
+    emit32(0);
+    return used - 4;
+}
+
+std::size_t Jit::jmp()
+{
+    emit8(0xE9);
+    emit32(0);
+    return used - 4;
+}
+
+void Jit::patch_jump(std::size_t site, std::size_t destination)
+{
+    unsigned int rel = static_cast<unsigned int>(destination - (site + 4));
+    for (unsigned int i = 0; i < 4; i++)
+        buffer[site + i] = (rel >> (i * 8)) & 0xFF;
+}
+
+// Back to the emulator with pc and exit kind in eax
+void Jit::exit_to(unsigned int pc_and_kind)
+{
+    emit8(0xB8);
+    emit32(pc_and_kind);
+    patch_jump(jmp(), epilogue);
+}
+
+// Exit to a known address, goes to the epilogue until a block at target is translated
+void Jit::chain_exit(unsigned short target)
+{
+    emit8(0xB8);
+    emit32(target);
+    std::size_t site = jmp();
+    if (blocks[target] != NULL)
+        patch_jump(site, static_cast<const unsigned char *>(blocks[target]) - buffer);
+    else
+    {
+        patch_jump(site, epilogue);
+        waiting[target].push_back(site);
+    }
+}
+
+// Address in eax. Memory mapped registers, and stores into decoded code, are left to the
+// interpreter: instruction index leaves through a side exit before anything changed
+void Jit::check_address(bool store, unsigned int index)
+{
+    emit8(0x3D); // cmp eax, MMIO_START
+    emit32(MMIO_START);
+    side_exits.push_back(std::make_pair(jcc(CC_AE), index));
+    if (!store)
+        return;
+    static const unsigned char code_check[] = {
+        0x41, 0x8A, 0x14, 0x02,       // mov dl, [r10 + rax]
+        0x41, 0x0A, 0x54, 0x02, 0x01, // or dl, [r10 + rax + 1]
+    };
+    for (unsigned char byte : code_check)
+        emit8(byte);
+    side_exits.push_back(std::make_pair(jcc(CC_NE), index));
+}
+
+// cmp or test of a and b, host flags are moved to psw bits. setcc writes only a byte, so the
+// registers it writes are cleared before the comparison
+void Jit::translate_flags(bool compare, unsigned int a, unsigned int b)
+{
+    emit8(0x31); // xor eax, eax
+    emit8(0xC0);
+    emit8(0x31); // xor ecx, ecx
+    emit8(0xC9);
+    if (compare)
+    {
+        emit8(0x31); // xor edx, edx
+        emit8(0xD2);
+    }
+    op16_rr(compare ? 0x39 : 0x85, a, b);
+    static const unsigned char zero[] = {0x0F, 0x94, 0xC0}; // setz al
+    for (unsigned char byte : zero)
+        emit8(byte);
+    if (compare)
+    {
+        static const unsigned char overflow_carry[] = {
+            0x0F, 0x90, 0xC1, // seto cl
+            0x0F, 0x92, 0xC2, // setc dl
+            0x8D, 0x04, 0x48, // lea eax, [rax + rcx * 2]
+            0x8D, 0x04, 0x90, // lea eax, [rax + rdx * 4]
+        };
+        for (unsigned char byte : overflow_carry)
+            emit8(byte);
+    }
+    const unsigned char negative[] = {
+        0x0F, 0x98, 0xC1,                                                  // sets cl
+        0x8D, 0x04, 0xC8,                                                  // lea eax, [rax + rcx * 8]
+        0x41, 0x83, 0xE1, static_cast<unsigned char>(compare ? 0xF0 : 0xF6), // and r9d, ~flags
+        0x41, 0x09, 0xC1,                                                  // or r9d, eax
+    };
+    for (unsigned char byte : negative)
+        emit8(byte);
+}
+
+/* ----- Translation ----- */
+
+const void *Jit::translate(unsigned short pc)
+{
+    // Block runs to the first branch, or up to an instruction that is left to the interpreter
+    std::vector<Decoded> body;
+    std::vector<unsigned short> addresses;
+    unsigned short address = pc;
+    bool branch = false;
+    while (!branch && body.size() < MAX_BLOCK_INSTRUCTIONS)
+    {
+        Decoded entry;
+        Handler_id id = emulator.decode(address, entry);
+        branch = is_branch(id);
+        if (!branch && !is_straight(id))
+            break;
+        body.push_back(entry);
+        addresses.push_back(address);
+        address += entry.size;
+    }
+    if (body.empty())
+    {
+        heat[pc] = NOT_TRANSLATABLE;
+        return NULL;
+    }
+    if (used + (body.size() + 2) * 128 > BUFFER_SIZE)
+        flush();
+    protect(true);
+
+    // Budget is taken for the whole block at entry, side exits give back what did not run
+    unsigned int n = body.size();
+    std::size_t start = used;
+
+    // A loop back to the block start does not need psw when its compare is the only instruction
+    // that touches psw and no instruction can leave the block early: the compare is run again
+    // only if the loop leaves through the budget check
+    bool quiet_loop = n >= 2 && body[n - 1].payload == pc;
+    for (unsigned int k = 0; k + 1 < n && quiet_loop; k++)
+    {
+        const Decoded &entry = body[k];
+        if (entry.d == EMU_PSW || entry.s == EMU_PSW || is_memory(static_cast<Handler_id>(entry.id)) ||
+            ((entry.id == H_CMP || entry.id == H_TEST) && k + 2 != n))
+            quiet_loop = false;
+    }
+
+    side_exits.clear();
+    emit8(0x49); // sub r11, n
+    emit8(0x83);
+    emit8(0xEB);
+    emit8(n);
+    std::size_t budget_exit = jcc(CC_L);
+    // Loop body starts on 32 bytes, so its few instructions stay in one line of the decoded
+    // instruction cache
+    if (quiet_loop)
+    {
+        while (used % 32 != 0)
+            emit8(0x90);
+    }
+    std::size_t body_start = used;
+
+    for (unsigned int k = 0; k < n; k++)
+    {
+        const Decoded &entry = body[k];
+        unsigned int d = host[entry.d];
+        unsigned int s = host[entry.s];
+        unsigned short next = addresses[k] + entry.size;
+        std::size_t site;
+        std::size_t other;
+
+        // Compare right before the conditional jump that ends the block: the jump tests host
+        // flags, psw is written on the way out. jgt after test reads o from an older compare
+        Handler_id jump = k + 2 == n ? static_cast<Handler_id>(body[k + 1].id) : H_INVALID;
+        if ((entry.id == H_CMP && (jump == H_JEQ_DIRECT || jump == H_JNE_DIRECT || jump == H_JGT_DIRECT)) ||
+            (entry.id == H_TEST && (jump == H_JEQ_DIRECT || jump == H_JNE_DIRECT)))
+        {
+            bool compare = entry.id == H_CMP;
+            unsigned char taken = jump == H_JEQ_DIRECT ? CC_E : jump == H_JNE_DIRECT ? CC_NE : CC_G;
+            op16_rr(compare ? 0x39 : 0x85, d, s);
+            if (body[k + 1].payload == pc && quiet_loop)
+            {
+                // Loop falls through into its budget check and jumps back to the body
+                site = jcc(taken ^ 1);
+                emit8(0x49); // sub r11, n
+                emit8(0x83);
+                emit8(0xEB);
+                emit8(n);
+                patch_jump(jcc(CC_GE), body_start);
+                translate_flags(compare, d, s);
+                emit8(0x49); // add r11, n
+                emit8(0x83);
+                emit8(0xC3);
+                emit8(n);
+                exit_to(pc | JIT_EXIT_BUDGET << 16);
+            }
+            else
+            {
+                site = jcc(taken ^ 1);
+                translate_flags(compare, d, s);
+                chain_exit(body[k + 1].payload);
+            }
+            patch_jump(site, used);
+            translate_flags(compare, d, s);
+            chain_exit(next + body[k + 1].size);
+            break;
+        }
+
+        switch (entry.id)
+        {
+        case H_XCHG:
+            op16_rr(0x87, d, s);
+            break;
+        case H_ADD:
+            op16_rr(0x01, d, s);
+            break;
+        case H_SUB:
+            op16_rr(0x29, d, s);
+            break;
+        case H_MUL:
+            emit8(0x66); // imul d, s
+            rex(d, s);
+            emit8(0x0F);
+            emit8(0xAF);
+            emit8(0xC0 | (d & 7) << 3 | (s & 7));
+            break;
+        case H_CMP:
+            translate_flags(true, d, s);
+            break;
+        case H_NOT:
+            emit8(0x66); // not d
+            rex(0, d);
+            emit8(0xF7);
+            emit8(0xD0 | (d & 7));
+            break;
+        case H_AND:
+            op16_rr(0x21, d, s);
+            break;
+        case H_OR:
+            op16_rr(0x09, d, s);
+            break;
+        case H_XOR:
+            op16_rr(0x31, d, s);
+            break;
+        case H_TEST:
+            translate_flags(false, d, s);
+            break;
+        case H_LDR_IMM:
+            mov16_ri(d, entry.payload);
+            break;
+        case H_LDR_REG:
+            op16_rr(0x89, d, s);
+            break;
+        case H_STR_REG:
+            op16_rr(0x89, s, d);
+            break;
+        case H_LDR_MEM:
+        case H_STR_MEM:
+        case H_LDR_IND:
+        case H_STR_IND:
+            if (entry.id == H_LDR_MEM || entry.id == H_STR_MEM)
+            {
+                emit8(0xB8); // mov eax, payload
+                emit32(entry.payload);
+            }
+            else
+            {
+                movzx_rr(RAX, s);
+                if (entry.payload != 0)
+                {
+                    emit8(0x05); // add eax, payload
+                    emit32(entry.payload);
+                    movzx_rr(RAX, RAX);
+                }
+            }
+            if (entry.id == H_LDR_MEM || entry.id == H_LDR_IND)
+            {
+                check_address(false, k);
+                movzx_load(d);
+            }
+            else
+            {
+                check_address(true, k);
+                mov16_store(d);
+            }
+            break;
+        case H_PUSH:
+        case H_CALL_DIRECT:
+            movzx_rr(RAX, host[EMU_SP]);
+            emit8(0x83); // add eax, -2
+            emit8(0xC0);
+            emit8(0xFE);
+            movzx_rr(RAX, RAX);
+            check_address(true, k);
+            if (entry.id == H_PUSH)
+                mov16_store(d);
+            else
+            {
+                emit8(0x66); // mov word [rsi + rax], next
+                emit8(0xC7);
+                emit8(0x04);
+                emit8(0x06);
+                emit16(next);
+            }
+            mov32_rr(host[EMU_SP], RAX);
+            if (entry.id == H_CALL_DIRECT)
+                chain_exit(entry.payload);
+            break;
+        case H_POP:
+        case H_RET:
+            movzx_rr(RAX, host[EMU_SP]);
+            check_address(false, k);
+            movzx_load(RCX);
+            emit8(0x83); // add eax, 2
+            emit8(0xC0);
+            emit8(0x02);
+            movzx_rr(RAX, RAX);
+            mov32_rr(host[EMU_SP], RAX);
+            if (entry.id == H_POP)
+            {
+                mov32_rr(d, RCX);
+                break;
+            }
+            {
+                // Return address is looked up in the block table, epilogue if it is not translated
+                unsigned long long table = reinterpret_cast<unsigned long long>(blocks.data());
+                mov32_rr(RAX, RCX);
+                emit8(0x48); // mov rdx, table
+                emit8(0xBA);
+                emit32(table & 0xFFFFFFFF);
+                emit32(table >> 32);
+                static const unsigned char lookup[] = {
+                    0x48, 0x8B, 0x14, 0xCA, // mov rdx, [rdx + rcx * 8]
+                    0x48, 0x85, 0xD2,       // test rdx, rdx
+                };
+                for (unsigned char byte : lookup)
+                    emit8(byte);
+                patch_jump(jcc(CC_E), epilogue);
+                emit8(0xFF); // jmp rdx
+                emit8(0xE2);
+            }
+            break;
+        case H_JMP_DIRECT:
+            chain_exit(entry.payload);
+            break;
+        case H_JEQ_DIRECT:
+        case H_JNE_DIRECT:
+            emit8(0x41); // test r9b, PSW_Z
+            emit8(0xF6);
+            emit8(0xC1);
+            emit8(PSW_Z);
+            site = jcc(entry.id == H_JEQ_DIRECT ? CC_NE : CC_E);
+            chain_exit(next);
+            patch_jump(site, used);
+            chain_exit(entry.payload);
+            break;
+        case H_JGT_DIRECT:
+        {
+            // Taken without Z and with N equal to O
+            mov32_rr(RAX, R9);
+            emit8(0xA8); // test al, PSW_Z
+            emit8(PSW_Z);
+            site = jcc(CC_NE);
+            mov32_rr(RCX, RAX);
+            static const unsigned char sign[] = {
+                0xC1, 0xE9, 0x02, // shr ecx, 2
+                0x31, 0xC8,       // xor eax, ecx
+                0xA8, PSW_O,      // test al, PSW_O
+            };
+            for (unsigned char byte : sign)
+                emit8(byte);
+            other = jcc(CC_NE);
+            chain_exit(entry.payload);
+            patch_jump(site, used);
+            patch_jump(other, used);
+            chain_exit(next);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    if (!branch)
+    {
+        if (n == MAX_BLOCK_INSTRUCTIONS)
+            chain_exit(address);
+        else
+            exit_to(address | JIT_EXIT_SIDE << 16);
+    }
+
+    patch_jump(budget_exit, used);
+    emit8(0x49); // add r11, n
+    emit8(0x83);
+    emit8(0xC3);
+    emit8(n);
+    exit_to(pc | JIT_EXIT_BUDGET << 16);
+    for (std::pair<std::size_t, unsigned int> &side_exit : side_exits)
+    {
+        patch_jump(side_exit.first, used);
+        emit8(0x49); // add r11, instructions that did not run
+        emit8(0x83);
+        emit8(0xC3);
+        emit8(n - side_exit.second);
+        exit_to(addresses[side_exit.second] | JIT_EXIT_SIDE << 16);
+    }
+
+    // Exits that waited for this block, its own loop included, jump straight to it
+    blocks[pc] = buffer + start;
+    for (std::size_t site : waiting[pc])
+        patch_jump(site, start);
+    waiting[pc].clear();
+    if (perf_map != NULL)
+        std::fprintf(perf_map, "%lx %zx guest_%04x\n", reinterpret_cast<unsigned long>(buffer + start), used - start, pc);
+    return blocks[pc];
+}
@@ -0,0 +1,235 @@
+#include "../inc/lexer.hpp"
+#include <cstring>
+
+static inline bool is_identifier_start(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static inline bool is_identifier_char(char c)
+{
+    return is_identifier_start(c) || (c >= '0' && c <= '9');
+}
+
+bool equal_ignore_case(std::string_view a, std::string_view b)
+{
+    if (a.length() != b.length())
+        return false;
+    for (std::size_t i = 0; i < a.length(); i++)
+    {
+        if (ascii_lower(a[i]) != ascii_lower(b[i]))
+            return false;
+    }
+    return true;
+}
+
+std::size_t Name_hash::operator()(std::string_view name) const
+{
+    // FNV-1a over lower case characters
+    std::size_t h = 14695981039346656037ull;
+    for (std::size_t i = 0; i < name.length(); i++)
+    {
+        h ^= ascii_lower(name[i]);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static inline int digit_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (ascii_lower(c) >= 'a' && ascii_lower(c) <= 'z')
+        return ascii_lower(c) - 'a' + 10;
+    return 36;
+}
+
+// One character of a quoted literal: plain character, \n, \t, \r, \0, \\, \', \" or \xHH.
+// Position is moved past it
+static bool decode_character(std::string_view text, std::size_t &position, unsigned char &value)
+{
+    if (position >= text.length())
+        return false;
+    if (text[position] != '\\')
+    {
+        value = static_cast<unsigned char>(text[position++]);
+        return true;
+    }
+    if (position + 1 >= text.length())
+        return false;
+    char escape = text[position + 1];
+    position += 2;
+    switch (escape)
+    {
+    case 'n':
+        value = '\n';
+        return true;
+    case 't':
+        value = '\t';
+        return true;
+    case 'r':
+        value = '\r';
+        return true;
+    case '0':
+        value = 0;
+        return true;
+    case '\\':
+    case '\'':
+    case '"':
+        value = escape;
+        return true;
+    case 'x':
+    case 'X':
+        if (position + 1 >= text.length() || digit_value(text[position]) >= 16 || digit_value(text[position + 1]) >= 16)
+            return false;
+        value = digit_value(text[position]) * 16 + digit_value(text[position + 1]);
+        position += 2;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static Literal_status parse_character(std::string_view token, unsigned int &value)
+{
+    if (token.length() < 3 || token[token.length() - 1] != '\'')
+        return LITERAL_INVALID;
+    token = token.substr(1, token.length() - 2);
+    std::size_t position = 0;
+    unsigned char c;
+    if (token == "'" || !decode_character(token, position, c) || position != token.length())
+        return LITERAL_INVALID;
+    value = c;
+    return LITERAL_OK;
+}
+
+bool parse_string_literal(std::string_view token, unsigned char *out, std::size_t &length)
+{
+    if (token.length() < 2 || token[0] != '"' || token[token.length() - 1] != '"')
+        return false;
+    token = token.substr(1, token.length() - 2);
+    length = 0;
+
+    // Runs without escapes are copied at once, only escapes are decoded one by one
+    std::size_t position = 0;
+    while (position < token.length())
+    {
+        std::size_t special = token.find_first_of("\\\"", position);
+        if (special == std::string_view::npos)
+            special = token.length();
+        if (out != NULL)
+            std::memcpy(out + length, token.data() + position, special - position);
+        length += special - position;
+        position = special;
+        if (position == token.length())
+            break;
+
+        unsigned char c;
+        if (token[position] == '"' || !decode_character(token, position, c))
+            return false;
+        if (out != NULL)
+            out[length] = c;
+        length++;
+    }
+    return true;
+}
+
+Literal_status parse_literal(std::string_view token, unsigned int &value)
+{
+    if (token.empty())
+        return LITERAL_NONE;
+    if (token[0] == '\'')
+        return parse_character(token, value);
+
+    bool negative = token[0] == '-';
+    if (negative)
+        token.remove_prefix(1);
+    if (token.empty() || token[0] < '0' || token[0] > '9')
+        return negative ? LITERAL_INVALID : LITERAL_NONE;
+
+    unsigned int base = 10;
+    if (token.length() > 1 && token[0] == '0')
+    {
+        switch (ascii_lower(token[1]))
+        {
+        case 'x':
+            base = 16;
+            break;
+        case 'b':
+            base = 2;
+            break;
+        case 'o':
+            base = 8;
+            break;
+        }
+        if (base != 10)
+        {
+            token.remove_prefix(2);
+            if (token.empty() || negative)
+                return LITERAL_INVALID;
+        }
+    }
+
+    // Digits are checked to the end even after value overflows, so malformed literal is reported as such
+    unsigned int result = 0;
+    bool overflow = false;
+    for (std::size_t i = 0; i < token.length(); i++)
+    {
+        unsigned int digit = digit_value(token[i]);
+        if (digit >= base)
+            return LITERAL_INVALID;
+        result = result * base + digit;
+        if (result > 0xFFFF)
+        {
+            overflow = true;
+            result = 0xFFFF;
+        }
+    }
+    if (overflow || (negative && result > 0x8000))
+        return LITERAL_OUT_OF_RANGE;
+
+    value = negative ? (0x10000 - result) & 0xFFFF : result;
+    return LITERAL_OK;
+}
+
+Token_class classify_token(std::string_view token)
+{
+    Token_class result = {TOK_UNDEFINED, KW_NONE, 0};
+    std::size_t length = token.length();
+    if (length == 0)
+        return result;
+
+    const char *s = token.data();
+
+    // label: identifier followed by ':'
+    if (s[length - 1] == ':')
+    {
+        for (std::size_t i = 0; i < length - 1; i++)
+        {
+            if (!is_identifier_char(s[i]))
+                return result;
+        }
+        result.type = TOK_LABEL;
+        return result;
+    }
+
+    // keywords: instructions, directives, sections and registers
+    unsigned char index = keyword_hash_table.slot[keyword_hash(s, length)];
+    if (index != KW_NONE && equal_ignore_case(std::string_view(keywords[index].name, keywords[index].length), token))
+    {
+        result.type = keywords[index].type;
+        result.id = keywords[index].id;
+        result.value = keywords[index].value;
+        return result;
+    }
+
+    if (!is_identifier_start(s[0]))
+        return result;
+    for (std::size_t i = 1; i < length; i++)
+    {
+        if (!is_identifier_char(s[i]))
+            return result;
+    }
+    result.type = TOK_SYMBOL;
+    return result;
+}
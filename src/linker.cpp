@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+
+#include "../inc/linker.hpp"
+#include "../inc/thread_pool.hpp"
+
+Linker::Linker(std::vector<std::string> inputs, std::string DestName, Linker_options options)
+    : objects(inputs.size())
+{
+    this->DestName = DestName;
+    this->options = options;
+    for (unsigned int i = 0; i < inputs.size(); i++)
+    {
+        objects[i].name = inputs[i];
+        objects[i].opened = false;
+    }
+}
+
+std::string Linker::get_diagnostics()
+{
+    return diagnostics.str();
+}
+
+bool Linker::link()
+{
+    return read_objects() && collect_sections() && place_sections() &&
+           collect_symbols() && build_image() && write_image();
+}
+
+bool Linker::read_objects()
+{
+    std::vector<std::function<void()>> tasks;
+    for (unsigned int i = 0; i < objects.size(); i++)
+    {
+        Input_object *obj = &objects[i];
+        tasks.push_back([obj]()
+                        { obj->opened = obj->file.open(obj->name); });
+    }
+    Thread_Pool pool(std::min<std::size_t>(options.threads, std::max<std::size_t>(objects.size(), 1)));
+    pool.run(tasks);
+
+    // Report in command line order
+    bool no_errors = true;
+    for (unsigned int i = 0; i < objects.size(); i++)
+    {
+        if (!objects[i].opened)
+        {
+            diagnostics << "Error: " << objects[i].name << " is not a valid object file" << std::endl;
+            no_errors = false;
+        }
+    }
+    return no_errors;
+}
+
+bool Linker::collect_sections()
+{
+    for (unsigned int i = 0; i < objects.size(); i++)
+    {
+        Object_File &file = objects[i].file;
+        objects[i].base.assign(file.header()->section_count, 0);
+        for (unsigned int j = 0; j < file.header()->section_count; j++)
+        {
+            const Object_section *sec = file.section(j);
+            if (sec->type == SECTION_UNDEFINED)
+                continue;
+
+            std::string_view name = file.string(sec->name);
+            std::unordered_map<std::string_view, unsigned int, Name_hash, Name_equal>::iterator it = section_index.find(name);
+            if (it == section_index.end())
+            {
+                it = section_index.emplace(name, sections.size()).first;
+                sections.push_back(Output_section(name));
+            }
+            Output_section &out = sections[it->second];
+            if ((unsigned long long)out.size + sec->size > LINKER_MMIO_START)
+            {
+                diagnostics << "Error: section " << name << " is larger than memory" << std::endl;
+                return false;
+            }
+            out.parts.push_back(Section_part{i, j, out.size});
+            out.size += sec->size;
+        }
+    }
+    return true;
+}
+
+bool Linker::place_sections()
+{
+    bool no_errors = true;
+    for (std::vector<Placement>::iterator it = options.places.begin(); it != options.places.end(); ++it)
+    {
+        std::unordered_map<std::string_view, unsigned int, Name_hash, Name_equal>::iterator sec = section_index.find(it->section);
+        if (sec == section_index.end())
+        {
+            diagnostics << "Error: placed section " << it->section << " is not in any object" << std::endl;
+            no_errors = false;
+            continue;
+        }
+        sections[sec->second].address = it->address;
+        sections[sec->second].placed = true;
+    }
+    if (!no_errors)
+        return false;
+
+    // The rest follow the highest placed section
+    unsigned int end = 0;
+    for (std::vector<Output_section>::iterator it = sections.begin(); it != sections.end(); ++it)
+    {
+        if (it->placed)
+            end = std::max(end, it->address + it->size);
+    }
+    for (std::vector<Output_section>::iterator it = sections.begin(); it != sections.end(); ++it)
+    {
+        if (it->placed)
+            continue;
+        it->address = end;
+        end += it->size;
+    }
+
+    std::vector<Output_section *> order;
+    for (std::vector<Output_section>::iterator it = sections.begin(); it != sections.end(); ++it)
+        order.push_back(&*it);
+    std::stable_sort(order.begin(), order.end(), [](const Output_section *a, const Output_section *b)
+                     { return a->address < b->address; });
+    // Empty sections take no memory, every other one has to start after all earlier ones end
+    const Output_section *furthest = NULL;
+    for (unsigned int i = 0; i < order.size(); i++)
+    {
+        if (order[i]->address + order[i]->size > LINKER_MMIO_START)
+        {
+            diagnostics << "Error: section " << order[i]->name << " overlaps memory mapped registers" << std::endl;
+            return false;
+        }
+        if (order[i]->size == 0)
+            continue;
+        if (furthest != NULL && furthest->address + furthest->size > order[i]->address)
+        {
+            diagnostics << "Error: sections " << furthest->name << " and " << order[i]->name << " overlap" << std::endl;
+            return false;
+        }
+        if (furthest == NULL || order[i]->address + order[i]->size > furthest->address + furthest->size)
+            furthest = order[i];
+    }
+
+    for (std::vector<Output_section>::iterator it = sections.begin(); it != sections.end(); ++it)
+    {
+        for (std::vector<Section_part>::iterator part = it->parts.begin(); part != it->parts.end(); ++part)
+            objects[part->object].base[part->section] = it->address + part->offset;
+    }
+    return true;
+}
+
+bool Linker::collect_symbols()
+{
+    std::size_t count = 0;
+    for (unsigned int i = 0; i < objects.size(); i++)
+        count += objects[i].file.header()->symbol_count;
+    globals.reserve(count);
+
+    bool no_errors = true;
+    for (unsigned int i = 0; i < objects.size(); i++)
+    {
+        Object_File &file = objects[i].file;
+        for (unsigned int j = 0; j < file.header()->symbol_count; j++)
+        {
+            const Object_symbol *smb = file.symbol(j);
+            if (!(smb->flags & SYMBOL_GLOBAL) || smb->section == Section_Table::UND)
+                continue;
+
+            unsigned int value = smb->section == SECTION_INDEX_ABSOLUTE ? smb->value : objects[i].base[smb->section] + smb->value;
+            std::pair<std::unordered_map<std::string_view, Global_symbol, Name_hash, Name_equal>::iterator, bool> result =
+                globals.emplace(file.string(smb->name), Global_symbol{i, value});
+            if (!result.second)
+            {
+                diagnostics << "Error: symbol " << file.string(smb->name) << " is defined in "
+                            << objects[result.first->second.object].name << " and " << objects[i].name << std::endl;
+                no_errors = false;
+            }
+        }
+    }
+    return no_errors;
+}
+
+bool Linker::resolve_symbol(Input_object &obj, unsigned int id, unsigned int &value)
+{
+    if (id >= obj.file.header()->symbol_count)
+    {
+        diagnostics << "Error: relocation refers to symbol " << id << " that is not in " << obj.name << std::endl;
+        return false;
+    }
+    const Object_symbol *smb = obj.file.symbol(id);
+    if (smb->section == SECTION_INDEX_ABSOLUTE)
+    {
+        value = smb->value;
+        return true;
+    }
+    if (smb->section != Section_Table::UND)
+    {
+        value = obj.base[smb->section] + smb->value;
+        return true;
+    }
+
+    std::unordered_map<std::string_view, Global_symbol, Name_hash, Name_equal>::iterator it = globals.find(obj.file.string(smb->name));
+    if (it == globals.end())
+    {
+        diagnostics << "Error: undefined symbol " << obj.file.string(smb->name) << " in " << obj.name << std::endl;
+        return false;
+    }
+    value = it->second.value;
+    return true;
+}
+
+bool Linker::build_image()
+{
+    std::vector<Output_section *> order;
+    unsigned int end = 0;
+    for (std::vector<Output_section>::iterator it = sections.begin(); it != sections.end(); ++it)
+    {
+        order.push_back(&*it);
+        end = std::max(end, it->address + it->size);
+    }
+    std::stable_sort(order.begin(), order.end(), [](const Output_section *a, const Output_section *b)
+                     { return a->address < b->address; });
+
+    // Zero fill comes from the image itself, only stored bytes are copied
+    image.assign(end, 0);
+    bool no_errors = true;
+    for (unsigned int i = 0; i < order.size(); i++)
+    {
+        for (std::vector<Section_part>::iterator part = order[i]->parts.begin(); part != order[i]->parts.end(); ++part)
+        {
+            Input_object &obj = objects[part->object];
+            const Object_section *sec = obj.file.section(part->section);
+            unsigned int base = obj.base[part->section];
+            std::copy(obj.file.section_data(part->section), obj.file.section_data(part->section) + sec->data_size,
+                      image.begin() + base);
+
+            const Relocation_record *records = obj.file.relocations(part->section);
+            for (unsigned int r = 0; r < sec->relocation_count; r++)
+            {
+                const Relocation_record &rel = records[r];
+                unsigned int symbol_value;
+                if (rel.offset + 2 > sec->data_size)
+                {
+                    diagnostics << "Error: relocation at " << rel.offset << " is outside of section "
+                                << order[i]->name << " in " << obj.name << std::endl;
+                    no_errors = false;
+                    continue;
+                }
+                if (!resolve_symbol(obj, rel.symbol_id, symbol_value))
+                {
+                    no_errors = false;
+                    continue;
+                }
+
+                // Addend is stored in place, S + A or S + A - P
+                unsigned int address = base + rel.offset;
+                unsigned int value = symbol_value + (image[address] | (image[address + 1] << 8));
+                if (rel.type == R_386_PC16)
+                    value -= address;
+                else if (rel.type != R_386_16)
+                {
+                    diagnostics << "Error: unknown relocation type " << (unsigned int)rel.type << " in " << obj.name << std::endl;
+                    no_errors = false;
+                    continue;
+                }
+                image[address] = value & 0xFF;
+                image[address + 1] = (value >> 8) & 0xFF;
+            }
+        }
+    }
+    return no_errors;
+}
+
+bool Linker::write_image()
+{
+    std::ofstream output(DestName, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!output.is_open())
+    {
+        diagnostics << "Output file error: " << DestName << std::endl;
+        return false;
+    }
+    if (!options.text_output)
+    {
+        output.write(reinterpret_cast<const char *>(image.data()), image.size());
+        return true;
+    }
+
+    // Rows of 8 bytes that cover a section, gaps between sections are left out
+    std::vector<bool> used((image.size() + 7) / 8, false);
+    for (std::vector<Output_section>::iterator it = sections.begin(); it != sections.end(); ++it)
+    {
+        for (unsigned int row = it->address / 8; row * 8 < it->address + it->size; row++)
+            used[row] = true;
+    }
+    std::stringstream text;
+    text << std::hex << std::uppercase << std::setfill('0');
+    for (unsigned int row = 0; row < used.size(); row++)
+    {
+        if (!used[row])
+            continue;
+        text << std::setw(4) << row * 8 << ":";
+        for (unsigned int i = row * 8; i < row * 8 + 8 && i < image.size(); i++)
+            text << " " << std::setw(2) << (unsigned int)image[i];
+        text << std::endl;
+    }
+    output << text.str();
+    return true;
+}
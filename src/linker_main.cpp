@@ -0,0 +1,96 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+
+#include "../inc/linker.hpp"
+#include "../inc/response_file.hpp"
+
+static void print_usage()
+{
+    std::cout << "Usage: linker [--text] [-place=section@address]... -o output_file input_file.o... | @response_file" << std::endl;
+    std::cout << "  --text              write hex dump instead of binary memory image" << std::endl;
+    std::cout << "  -place=name@addr    place section at address, others follow the highest placed one" << std::endl;
+    std::cout << "  -j N                threads for reading objects" << std::endl;
+}
+
+static bool parse_placement(std::string arg, Placement &place)
+{
+    std::size_t at = arg.find('@');
+    if (at == std::string::npos || at == 0 || at + 1 == arg.length())
+        return false;
+
+    char *end;
+    unsigned long address = std::strtoul(arg.c_str() + at + 1, &end, 0);
+    if (*end != '\0' || address > 0xFFFF)
+        return false;
+    place.section = arg.substr(0, at);
+    place.address = address;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string DestName;
+    std::vector<std::string> inputs;
+    Linker_options options;
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Command: linker -place=ivt@0x0000 -o program.hex interrupts.o main.o
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+        {
+            DestName = argv[++i];
+        }
+        else if (arg == "-j" && i + 1 < argc)
+        {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--text" || arg == "-hex")
+        {
+            options.text_output = true;
+        }
+        else if (arg.rfind("-place=", 0) == 0 || arg.rfind("--place=", 0) == 0)
+        {
+            Placement place;
+            if (!parse_placement(arg.substr(arg.find('=') + 1), place))
+            {
+                std::cout << "Invalid placement: " << arg << std::endl;
+                return 1;
+            }
+            options.places.push_back(place);
+        }
+        else if (arg[0] == '@')
+        {
+            if (!read_response_file(arg.substr(1), inputs))
+                return 1;
+        }
+        else if (arg[0] == '-')
+        {
+            print_usage();
+            return 1;
+        }
+        else
+        {
+            inputs.push_back(arg);
+        }
+    }
+
+    if (DestName.empty() || inputs.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    Linker linker(inputs, DestName, options);
+    bool no_errors = linker.link();
+    std::cout << linker.get_diagnostics();
+    std::cout << std::endl
+              << (no_errors ? "Linking successful!" : "Linking failed!") << std::endl;
+    return no_errors ? 0 : 1;
+}
@@ -1,25 +1,274 @@
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <cstdlib>
+#include <new>
 
 #include "../inc/assembler.hpp"
+#include "../inc/thread_pool.hpp"
+#include "../inc/stats.hpp"
+#include "../inc/response_file.hpp"
+
+// Counting allocator for --stats
+void *operator new(std::size_t size)
+{
+    heap_allocations++;
+    void *memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == NULL)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+typedef struct stats_options
+{
+    bool text;             // print after assembly
+    std::string json_file; // write as json, empty if not requested
+
+    stats_options()
+    {
+        this->text = false;
+    }
+} Stats_options;
+
+typedef struct batch_job
+{
+    std::string source;
+    std::string dest;
+    std::uintmax_t size;
+    bool success;
+    std::string diagnostics;
+    Assembler_stats stats;
+} Batch_job;
+
+static void print_usage()
+{
+    std::cout << "Usage: asembler [--text] -o output_file.o input_file.s" << std::endl;
+    std::cout << "       asembler [--text] [-j N] -o output_dir input_file.s... | @response_file" << std::endl;
+    std::cout << "  --text              write textual tables instead of binary object file" << std::endl;
+    std::cout << "  -t, --threads N     worker threads for every source file" << std::endl;
+    std::cout << "  --single-pass       encode while reading and patch forward references" << std::endl;
+    std::cout << "  --verify            decode output and compare it with source instructions" << std::endl;
+    std::cout << "  --stats             print phase times and counters" << std::endl;
+    std::cout << "  --stats-json file   write phase times and counters as json" << std::endl;
+}
+
+static bool assemble_file(std::string SourceName, std::string DestName, Assembler_options options,
+                          std::string &diagnostics, Assembler_stats &stats)
+{
+    Assembler assembler(SourceName, DestName, options);
+    bool no_errors = assembler.assemble();
+    diagnostics = assembler.get_diagnostics();
+    stats = assembler.get_stats();
+    return no_errors;
+}
+
+static bool report_stats(std::vector<std::string> &sources, std::vector<Assembler_stats> &stats, Stats_options stats_options)
+{
+    Assembler_stats total;
+    for (unsigned int i = 0; i < stats.size(); i++)
+        total.add(stats[i]);
+
+    if (stats_options.text)
+    {
+        std::cout << std::endl;
+        for (unsigned int i = 0; i < stats.size(); i++)
+            std::cout << write_stats_text(sources[i], stats[i]);
+        if (stats.size() > 1)
+            std::cout << write_stats_text("all files", total);
+    }
+
+    if (!stats_options.json_file.empty())
+    {
+        std::ofstream json(stats_options.json_file, std::ios::out | std::ios::trunc);
+        if (!json.is_open())
+        {
+            std::cout << "Stats file error: " << stats_options.json_file << std::endl;
+            return false;
+        }
+        json << "{\"files\": [";
+        for (unsigned int i = 0; i < stats.size(); i++)
+            json << (i ? ",\n  " : "\n  ") << write_stats_json(sources[i], stats[i]);
+        json << "],\n \"total\": " << write_stats_json("", total) << "}" << std::endl;
+    }
+    return true;
+}
+
+static int run_batch(std::vector<std::string> &sources, std::string DestDir, unsigned int workers,
+                     Assembler_options options, Stats_options stats_options)
+{
+    std::error_code error;
+    std::filesystem::create_directories(DestDir, error);
+
+    std::vector<Batch_job> jobs(sources.size());
+    for (unsigned int i = 0; i < sources.size(); i++)
+    {
+        std::filesystem::path source(sources[i]);
+        jobs[i].source = sources[i];
+        jobs[i].dest = (std::filesystem::path(DestDir) / source.stem()).string() + ".o";
+        jobs[i].size = std::filesystem::file_size(source, error);
+        if (error)
+            jobs[i].size = 0;
+        jobs[i].success = false;
+    }
+
+    // Inputs with the same name in different directories would write the same object
+    std::map<std::string, unsigned int> outputs;
+    for (unsigned int i = 0; i < jobs.size(); i++)
+    {
+        std::pair<std::map<std::string, unsigned int>::iterator, bool> inserted = outputs.insert(std::make_pair(jobs[i].dest, i));
+        if (!inserted.second)
+        {
+            std::cout << "Output name conflict: " << jobs[inserted.first->second].source << " and " << jobs[i].source
+                      << " are both written to " << jobs[i].dest << std::endl;
+            return 1;
+        }
+    }
+
+    // Larger files first, so the longest jobs do not end up last on one worker
+    std::vector<Batch_job *> order;
+    for (unsigned int i = 0; i < jobs.size(); i++)
+        order.push_back(&jobs[i]);
+    std::stable_sort(order.begin(), order.end(), [](const Batch_job *a, const Batch_job *b)
+                     { return a->size > b->size; });
+
+    std::vector<std::function<void()>> tasks;
+    for (unsigned int i = 0; i < order.size(); i++)
+    {
+        Batch_job *job = order[i];
+        tasks.push_back([job, options]()
+                        {
+                            try
+                            {
+                                job->success = assemble_file(job->source, job->dest, options, job->diagnostics, job->stats);
+                            }
+                            catch (std::exception &e)
+                            {
+                                job->diagnostics += std::string("Standard exception: ") + e.what() + "\n";
+                                job->success = false;
+                            } });
+    }
+
+    Thread_Pool pool(workers);
+    pool.run(tasks);
+
+    // Report in command line order
+    unsigned int failed = 0;
+    for (unsigned int i = 0; i < jobs.size(); i++)
+    {
+        std::cout << jobs[i].diagnostics;
+        std::cout << jobs[i].source << ": " << (jobs[i].success ? "Assembly successful!" : "Assembly failed!") << std::endl;
+        if (!jobs[i].success)
+            failed++;
+    }
+    std::cout << std::endl
+              << jobs.size() - failed << " of " << jobs.size() << " files assembled" << std::endl;
+
+    std::vector<Assembler_stats> stats;
+    for (unsigned int i = 0; i < jobs.size(); i++)
+        stats.push_back(jobs[i].stats);
+    if (!report_stats(sources, stats, stats_options))
+        return 1;
+
+    return failed == 0 ? 0 : 1;
+}
 
 int main(int argc, char *argv[])
 {
 
     bool no_errors;
+    bool batch = false;
+    unsigned int workers = std::thread::hardware_concurrency();
     std::string SourceName, DestName;
+    std::vector<std::string> sources;
+    Assembler_options options;
+    Stats_options stats_options;
 
     // Command: asembler -o izlaz.o ulaz.s
+    //          asembler -j 8 -o izlaz_dir ulaz1.s ulaz2.s ...
 
     // Handle command line parameters
-    SourceName = argv[3];
-    DestName = argv[2];
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+        {
+            DestName = argv[++i];
+        }
+        else if (arg == "-j" && i + 1 < argc)
+        {
+            workers = std::max(1, std::atoi(argv[++i]));
+            batch = true;
+        }
+        else if (arg == "--text")
+        {
+            options.text_output = true;
+        }
+        else if ((arg == "-t" || arg == "--threads") && i + 1 < argc)
+        {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--single-pass")
+        {
+            options.single_pass = true;
+        }
+        else if (arg == "--verify")
+        {
+            options.verify = true;
+        }
+        else if (arg == "--stats")
+        {
+            stats_options.text = true;
+        }
+        else if (arg == "--stats-json" && i + 1 < argc)
+        {
+            stats_options.json_file = argv[++i];
+        }
+        else if (arg[0] == '@')
+        {
+            if (!read_response_file(arg.substr(1), sources))
+                return 1;
+            batch = true;
+        }
+        else if (arg[0] == '-')
+        {
+            print_usage();
+            return 1;
+        }
+        else
+        {
+            sources.push_back(arg);
+        }
+    }
+
+    if (DestName.empty() || sources.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    if (batch || sources.size() > 1)
+        return run_batch(sources, DestName, workers, options, stats_options);
 
-    // std::cout << SourceName << std::endl;
-    // std::cout << DestName << std::endl;
+    SourceName = sources[0];
 
-    Assembler *AS = new Assembler(SourceName, DestName);
-    no_errors = AS->assemble();
+    std::string diagnostics;
+    std::vector<Assembler_stats> stats(1);
+    no_errors = assemble_file(SourceName, DestName, options, diagnostics, stats[0]);
+    std::cout << diagnostics;
 
     if (!no_errors)
     {
@@ -32,7 +281,8 @@ int main(int argc, char *argv[])
                   << "Assembly successful!" << std::endl;
     }
 
-    delete AS;
+    if (!report_stats(sources, stats, stats_options))
+        return 1;
 
-    return 0;
-}
\ No newline at end of file
+    return no_errors ? 0 : 1;
+}
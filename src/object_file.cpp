@@ -0,0 +1,252 @@
+#include "../inc/object_file.hpp"
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+Object_File::Object_File()
+{
+    data = NULL;
+    length = 0;
+    mapping = NULL;
+}
+
+Object_File::~Object_File()
+{
+    close();
+}
+
+static void align(std::string &buffer)
+{
+    while (buffer.size() % OBJECT_ALIGNMENT != 0)
+        buffer.push_back('\0');
+}
+
+static void append(std::string &buffer, const void *bytes, std::size_t size)
+{
+    buffer.append(static_cast<const char *>(bytes), size);
+}
+
+static unsigned int add_string(std::string &strings, std::string_view name)
+{
+    unsigned int offset = strings.size();
+    strings.append(name.data(), name.size());
+    strings.push_back('\0');
+    return offset;
+}
+
+std::string Object_File::write(Symbol_Table &symbol_table, Section_Table &section_table, Relocation_Table &relocation_table)
+{
+    std::string strings(1, '\0'); // offset 0 is empty name
+    std::vector<Object_section> sections(section_table.size());
+    std::vector<Object_symbol> symbols(symbol_table.size());
+    std::vector<Relocation_record> relocations;
+    relocation_table.sort_by_offset();
+
+    for (unsigned int i = 0; i < sections.size(); i++)
+    {
+        Section &sec = section_table.get_section(i);
+        const std::vector<Relocation_record> &records = relocation_table.get_section_relocations(i);
+        sections[i].name = add_string(strings, sec.name);
+        sections[i].size = std::max<std::size_t>(sec.size, sec.bytecode.size());
+        sections[i].data_size = sec.bytecode.size();
+        if (i == Section_Table::UND)
+            sections[i].type = SECTION_UNDEFINED;
+        else
+            sections[i].type = sections[i].data_size == 0 && sections[i].size > 0 ? SECTION_NOBITS : SECTION_PROGBITS;
+        sections[i].data_offset = 0;
+        sections[i].relocation_index = relocations.size();
+        sections[i].relocation_count = records.size();
+        relocations.insert(relocations.end(), records.begin(), records.end());
+    }
+
+    // Symbols are written in id order, so relocations index them directly
+    for (unsigned int i = 0; i < symbols.size(); i++)
+    {
+        Symbol &smb = symbol_table.get_symbol(i);
+        symbols[i].name = add_string(strings, smb.name);
+        symbols[i].value = smb.offset;
+        symbols[i].section = smb.section;
+        symbols[i].flags = smb.local ? 0 : SYMBOL_GLOBAL;
+    }
+
+    Object_header header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = OBJECT_MAGIC;
+    header.version = OBJECT_VERSION;
+    header.section_count = sections.size();
+    header.symbol_count = symbols.size();
+    header.relocation_count = relocations.size();
+    header.string_table_size = strings.size();
+
+    // Compute layout, every part is aligned
+    unsigned int offset = sizeof(Object_header);
+    header.section_table_offset = offset;
+    offset += sections.size() * sizeof(Object_section);
+    offset = (offset + OBJECT_ALIGNMENT - 1) / OBJECT_ALIGNMENT * OBJECT_ALIGNMENT;
+    header.symbol_table_offset = offset;
+    offset += symbols.size() * sizeof(Object_symbol);
+    offset = (offset + OBJECT_ALIGNMENT - 1) / OBJECT_ALIGNMENT * OBJECT_ALIGNMENT;
+    header.relocation_table_offset = offset;
+    offset += relocations.size() * sizeof(Relocation_record);
+    offset = (offset + OBJECT_ALIGNMENT - 1) / OBJECT_ALIGNMENT * OBJECT_ALIGNMENT;
+    header.string_table_offset = offset;
+    offset += strings.size();
+    for (unsigned int i = 0; i < sections.size(); i++)
+    {
+        offset = (offset + OBJECT_ALIGNMENT - 1) / OBJECT_ALIGNMENT * OBJECT_ALIGNMENT;
+        sections[i].data_offset = offset;
+        offset += sections[i].data_size;
+    }
+    header.file_size = (offset + OBJECT_ALIGNMENT - 1) / OBJECT_ALIGNMENT * OBJECT_ALIGNMENT;
+
+    std::string buffer;
+    buffer.reserve(header.file_size);
+    append(buffer, &header, sizeof(header));
+    append(buffer, sections.data(), sections.size() * sizeof(Object_section));
+    align(buffer);
+    append(buffer, symbols.data(), symbols.size() * sizeof(Object_symbol));
+    align(buffer);
+    append(buffer, relocations.data(), relocations.size() * sizeof(Relocation_record));
+    align(buffer);
+    buffer += strings;
+    for (unsigned int i = 0; i < sections.size(); i++)
+    {
+        align(buffer);
+        const std::vector<unsigned char> &bytes = section_table.get_section(i).bytecode;
+        append(buffer, bytes.data(), bytes.size());
+    }
+    align(buffer);
+    return buffer;
+}
+
+bool Object_File::open(std::string name)
+{
+    close();
+    int fd = ::open(name.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Object_header))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    mapping = map;
+    data = static_cast<const unsigned char *>(map);
+    length = st.st_size;
+    if (!validate())
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool Object_File::open(const unsigned char *data, std::size_t length)
+{
+    close();
+    this->data = data;
+    this->length = length;
+    if (!validate())
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void Object_File::close()
+{
+    if (mapping != NULL)
+        munmap(mapping, length);
+    mapping = NULL;
+    data = NULL;
+    length = 0;
+}
+
+bool Object_File::validate()
+{
+    if (length < sizeof(Object_header) || reinterpret_cast<std::uintptr_t>(data) % OBJECT_ALIGNMENT != 0)
+        return false;
+
+    const Object_header *h = header();
+    if (h->magic != OBJECT_MAGIC || h->version != OBJECT_VERSION || h->file_size > length)
+        return false;
+
+    // every table has to be aligned and inside file
+    if ((h->section_table_offset | h->symbol_table_offset | h->relocation_table_offset | h->string_table_offset) % OBJECT_ALIGNMENT != 0)
+        return false;
+    if ((unsigned long long)h->section_table_offset + (unsigned long long)h->section_count * sizeof(Object_section) > length ||
+        (unsigned long long)h->symbol_table_offset + (unsigned long long)h->symbol_count * sizeof(Object_symbol) > length ||
+        (unsigned long long)h->relocation_table_offset + (unsigned long long)h->relocation_count * sizeof(Relocation_record) > length ||
+        (unsigned long long)h->string_table_offset + h->string_table_size > length ||
+        h->string_table_size == 0 || string(0)[h->string_table_size - 1] != '\0')
+        return false;
+
+    for (unsigned int i = 0; i < h->section_count; i++)
+    {
+        const Object_section *sec = section(i);
+        if ((unsigned long long)sec->data_offset + sec->data_size > length || sec->data_size > sec->size ||
+            sec->data_offset % OBJECT_ALIGNMENT != 0 ||
+            (unsigned long long)sec->relocation_index + sec->relocation_count > h->relocation_count ||
+            sec->name >= h->string_table_size)
+            return false;
+
+        // Relocations belong to this section, patch stored bytes and refer to existing symbols
+        const Relocation_record *records = relocations(i);
+        for (unsigned int j = 0; j < sec->relocation_count; j++)
+        {
+            if (records[j].section != i || records[j].symbol_id >= h->symbol_count ||
+                (unsigned long long)records[j].offset + 2 > sec->data_size || records[j].type > R_386_PC16)
+                return false;
+        }
+    }
+    for (unsigned int i = 0; i < h->symbol_count; i++)
+    {
+        const Object_symbol *smb = symbol(i);
+        if (smb->name >= h->string_table_size || (smb->section >= h->section_count && smb->section != SECTION_INDEX_ABSOLUTE))
+            return false;
+    }
+    return true;
+}
+
+const Object_header *Object_File::header()
+{
+    return reinterpret_cast<const Object_header *>(data);
+}
+
+const Object_section *Object_File::section(unsigned int index)
+{
+    return reinterpret_cast<const Object_section *>(data + header()->section_table_offset) + index;
+}
+
+const Object_symbol *Object_File::symbol(unsigned int index)
+{
+    return reinterpret_cast<const Object_symbol *>(data + header()->symbol_table_offset) + index;
+}
+
+const Relocation_record *Object_File::relocations(unsigned int section)
+{
+    return reinterpret_cast<const Relocation_record *>(data + header()->relocation_table_offset) +
+           this->section(section)->relocation_index;
+}
+
+const unsigned char *Object_File::section_data(unsigned int section)
+{
+    return data + this->section(section)->data_offset;
+}
+
+const char *Object_File::string(unsigned int offset)
+{
+    return reinterpret_cast<const char *>(data + header()->string_table_offset) + offset;
+}
@@ -9,53 +9,90 @@ Relocation_Table::~Relocation_Table()
 {
 }
 
-unsigned int Relocation_Table::insert_relocation_record(std::string section, unsigned int offset,
-                                                        unsigned int symbol_id, std::string type)
+unsigned int Relocation_Table::insert_relocation_record(unsigned int section, unsigned int offset,
+                                                        unsigned int symbol_id, Relocation_type type)
 {
-    Relocation_record smb = relocation_record(section, offset, symbol_id, type);
+    if (section >= table.size())
+        table.resize(section + 1);
 
-    auto ret = table.insert(std::pair<unsigned int, Relocation_record>(++global_id, smb));
-    return global_id;
+    Relocation_record record;
+    record.offset = offset;
+    record.symbol_id = symbol_id;
+    record.section = section;
+    record.type = type;
+    record.padding = 0;
+
+    table[section].push_back(record);
+    count++;
+    return table[section].size() - 1;
+}
+
+const std::vector<Relocation_record> &Relocation_Table::get_section_relocations(unsigned int section)
+{
+    static const std::vector<Relocation_record> no_relocations;
+    if (section >= table.size())
+        return no_relocations;
+    return table[section];
 }
 
-std::string Relocation_Table::write_relocation_table()
+unsigned int Relocation_Table::size()
+{
+    return count;
+}
+
+const char *Relocation_Table::type_name(unsigned char type)
+{
+    return type == R_386_PC16 ? "R_386_PC16" : "R_386_16";
+}
+
+void Relocation_Table::sort_by_offset()
+{
+    // Records are appended in order of location counter, so this is almost always already sorted
+    for (std::vector<std::vector<Relocation_record>>::iterator it = table.begin(); it != table.end(); ++it)
+    {
+        std::stable_sort(it->begin(), it->end(), [](const Relocation_record &a, const Relocation_record &b)
+                         { return a.offset < b.offset; });
+    }
+}
+
+std::string Relocation_Table::write_relocation_table(Section_Table &section_table)
 {
-    std::map<unsigned int, Relocation_record>::iterator it = table.begin();
     std::stringstream sstream;
+    sort_by_offset();
 
     sstream << std::endl
             << "#Relocation table" << std::endl;
-    sstream << "#Rel id | Sym id | LC offset | Type | section" << std::endl;
-    sstream << "#-------------------------------------------------" << std::endl;
-    for (it = table.begin(); it != table.end(); ++it)
+    for (unsigned int section = 0; section < table.size(); section++)
     {
-        sstream << "   " << it->first << "    |   " << it->second.symbol_id << "    |     " << it->second.offset << "     | " << it->second.type << " | " << it->second.section << std::endl;
+        if (table[section].empty())
+            continue;
+        sstream << "#.rela." << section_table.get_section(section).name << std::endl;
+        sstream << "#Rel id | Sym id | LC offset | Type" << std::endl;
+        sstream << "#-------------------------------------------------" << std::endl;
+        for (unsigned int i = 0; i < table[section].size(); i++)
+        {
+            const Relocation_record &record = table[section][i];
+            sstream << "   " << i << "    |   " << record.symbol_id << "    |     " << record.offset << "     | " << type_name(record.type) << std::endl;
+        }
     }
     sstream << std::endl;
     return sstream.str();
 }
 
-std::string Relocation_Table::debug_write_relocation_table()
+std::string Relocation_Table::debug_write_relocation_table(Section_Table &section_table)
 {
-    std::map<unsigned int, Relocation_record>::iterator it = table.begin();
-
     std::cout << " === RELOCATION TABLE === " << std::endl;
-    std::cout << " Reloc id | Symbol ID | LC offset | Type | section" << std::endl;
-    std::cout << "-------------------------------------------------" << std::endl;
-    for (it = table.begin(); it != table.end(); ++it)
+    for (unsigned int section = 0; section < table.size(); section++)
     {
-        std::cout << it->first << "    | " << it->second.symbol_id << " |   " << it->second.offset << "   |   " << it->second.type << "   | " << it->second.section << std::endl;
+        std::cout << " Section " << section_table.get_section(section).name << std::endl;
+        std::cout << " Reloc id | Symbol ID | LC offset | Type" << std::endl;
+        std::cout << "-------------------------------------------------" << std::endl;
+        for (unsigned int i = 0; i < table[section].size(); i++)
+        {
+            const Relocation_record &record = table[section][i];
+            std::cout << i << "    | " << record.symbol_id << " |   " << record.offset << "   |   " << type_name(record.type) << std::endl;
+        }
     }
 
     return "";
 }
-
-bool Relocation_Table::relocation_record_exists(unsigned int symbol_id)
-{
-    if (table.find(symbol_id) != table.end())
-    {
-        return true;
-    }
-    else
-        return false;
-}
@@ -0,0 +1,23 @@
+#include <iostream>
+#include <fstream>
+
+#include "../inc/response_file.hpp"
+
+bool read_response_file(std::string name, std::vector<std::string> &paths)
+{
+    std::ifstream response(name);
+    if (!response.is_open())
+    {
+        std::cout << "Response file error: " << name << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(response, line))
+    {
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty())
+            paths.push_back(line);
+    }
+    return true;
+}
@@ -0,0 +1,385 @@
+#include "../inc/scanner.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+typedef void (*Scan_block_function)(const char *block, Block_masks &masks);
+typedef void (*Fold_function)(const char *in, std::size_t length, char *out);
+
+/* ----- Scalar kernels, used on every cpu and for tails of vector kernels ----- */
+
+const unsigned char CLASS_NEWLINE = 1;
+const unsigned char CLASS_COMMENT = 2;
+const unsigned char CLASS_DELIMITER = 4;
+const unsigned char CLASS_QUOTE = 8;
+
+typedef struct class_table
+{
+    unsigned char value[256];
+} Class_table;
+
+static constexpr Class_table build_class_table()
+{
+    Class_table table = {{}};
+    table.value[static_cast<unsigned char>('\n')] = CLASS_NEWLINE;
+    table.value[static_cast<unsigned char>('#')] = CLASS_COMMENT;
+    table.value[static_cast<unsigned char>(' ')] = CLASS_DELIMITER;
+    table.value[static_cast<unsigned char>('+')] = CLASS_DELIMITER;
+    table.value[static_cast<unsigned char>(',')] = CLASS_DELIMITER;
+    table.value[static_cast<unsigned char>('\t')] = CLASS_DELIMITER;
+    table.value[static_cast<unsigned char>('\r')] = CLASS_DELIMITER;
+    table.value[static_cast<unsigned char>('\'')] = CLASS_QUOTE;
+    table.value[static_cast<unsigned char>('"')] = CLASS_QUOTE;
+    return table;
+}
+
+static constexpr Class_table class_table = build_class_table();
+
+static void scan_block_scalar(const char *block, Block_masks &masks)
+{
+    masks.newline = masks.comment = masks.delimiter = masks.quote = 0;
+    for (std::size_t i = 0; i < SCAN_BLOCK_SIZE; i++)
+    {
+        unsigned char c = class_table.value[static_cast<unsigned char>(block[i])];
+        std::uint64_t bit = std::uint64_t(1) << i;
+        if (c & CLASS_NEWLINE)
+            masks.newline |= bit;
+        if (c & CLASS_COMMENT)
+            masks.comment |= bit;
+        if (c & CLASS_DELIMITER)
+            masks.delimiter |= bit;
+        if (c & CLASS_QUOTE)
+            masks.quote |= bit;
+    }
+}
+
+static void fold_lower_scalar(const char *in, std::size_t length, char *out)
+{
+    for (std::size_t i = 0; i < length; i++)
+        out[i] = (in[i] >= 'A' && in[i] <= 'Z') ? in[i] - 'A' + 'a' : in[i];
+}
+
+/* ----- SSE2 kernels, 4 x 16 bytes per block ----- */
+
+#ifdef SCAN_X86
+__attribute__((target("sse2"))) static void scan_block_sse2(const char *block, Block_masks &masks)
+{
+    masks.newline = masks.comment = masks.delimiter = masks.quote = 0;
+    for (std::size_t i = 0; i < SCAN_BLOCK_SIZE; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + i));
+        __m128i delimiter = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('+'))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(',')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        __m128i quote = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')), _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        masks.newline |= std::uint64_t(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))))) << i;
+        masks.comment |= std::uint64_t(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('#'))))) << i;
+        masks.delimiter |= std::uint64_t(static_cast<std::uint16_t>(_mm_movemask_epi8(delimiter))) << i;
+        masks.quote |= std::uint64_t(static_cast<std::uint16_t>(_mm_movemask_epi8(quote))) << i;
+    }
+}
+
+__attribute__((target("sse2"))) static void fold_lower_sse2(const char *in, std::size_t length, char *out)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        // signed compare, bytes over 0x7F are negative and never folded
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v));
+        v = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), v);
+    }
+    fold_lower_scalar(in + i, length - i, out + i);
+}
+
+/* ----- AVX2 kernels, 2 x 32 bytes per block ----- */
+
+__attribute__((target("avx2"))) static void scan_block_avx2(const char *block, Block_masks &masks)
+{
+    masks.newline = masks.comment = masks.delimiter = masks.quote = 0;
+    for (std::size_t i = 0; i < SCAN_BLOCK_SIZE; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + i));
+        __m256i delimiter = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('+'))),
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+        __m256i quote = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        masks.newline |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))))) << i;
+        masks.comment |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('#'))))) << i;
+        masks.delimiter |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(delimiter))) << i;
+        masks.quote |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(quote))) << i;
+    }
+}
+
+__attribute__((target("avx2"))) static void fold_lower_avx2(const char *in, std::size_t length, char *out)
+{
+    std::size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+        v = _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), v);
+    }
+    fold_lower_sse2(in + i, length - i, out + i);
+}
+#endif
+
+/* ----- Runtime selection ----- */
+
+static bool kernel_supported(Scan_kernel kernel)
+{
+    switch (kernel)
+    {
+    case SCAN_SCALAR:
+        return true;
+#ifdef SCAN_X86
+    case SCAN_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case SCAN_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+static Scan_kernel detect_scan_kernel()
+{
+    if (kernel_supported(SCAN_AVX2))
+        return SCAN_AVX2;
+    if (kernel_supported(SCAN_SSE2))
+        return SCAN_SSE2;
+    return SCAN_SCALAR;
+}
+
+static Scan_kernel current_kernel = SCAN_SCALAR;
+static Scan_block_function scan_block_kernel = scan_block_scalar;
+static Fold_function fold_lower_kernel = fold_lower_scalar;
+[[maybe_unused]] static bool kernels_selected = use_scan_kernel(detect_scan_kernel());
+
+Scan_kernel active_scan_kernel()
+{
+    return current_kernel;
+}
+
+bool use_scan_kernel(Scan_kernel kernel)
+{
+    if (!kernel_supported(kernel))
+        return false;
+
+    switch (kernel)
+    {
+#ifdef SCAN_X86
+    case SCAN_AVX2:
+        scan_block_kernel = scan_block_avx2;
+        fold_lower_kernel = fold_lower_avx2;
+        break;
+    case SCAN_SSE2:
+        scan_block_kernel = scan_block_sse2;
+        fold_lower_kernel = fold_lower_sse2;
+        break;
+#endif
+    default:
+        scan_block_kernel = scan_block_scalar;
+        fold_lower_kernel = fold_lower_scalar;
+        break;
+    }
+    current_kernel = kernel;
+    return true;
+}
+
+const char *scan_kernel_name(Scan_kernel kernel)
+{
+    switch (kernel)
+    {
+    case SCAN_AVX2:
+        return "avx2";
+    case SCAN_SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+void fold_lower(const char *in, std::size_t length, char *out)
+{
+    fold_lower_kernel(in, length, out);
+}
+
+/* ----- Line scanner ----- */
+
+Line_Scanner::Line_Scanner(std::string_view text)
+{
+    this->text = text;
+    block = 0;
+    starts = 0;
+    ends = 0;
+    newlines = 0;
+    previous_token = 0;
+    in_comment = false;
+    in_quote = 0;
+    escaped = false;
+    loaded = false;
+    token_start = 0;
+    line_start = 0;
+}
+
+bool Line_Scanner::load_block()
+{
+    std::size_t offset = loaded ? block + SCAN_BLOCK_SIZE : 0;
+    if (offset >= text.length())
+        return false;
+
+    Block_masks masks;
+    const char *data = text.data() + offset;
+    char padded[SCAN_BLOCK_SIZE];
+    if (text.length() - offset < SCAN_BLOCK_SIZE)
+    {
+        // last block is padded with delimiters, so open token ends at end of text
+        std::memset(padded, ' ', SCAN_BLOCK_SIZE);
+        std::memcpy(padded, data, text.length() - offset);
+        data = padded;
+    }
+    scan_block_kernel(data, masks);
+    block = offset;
+    loaded = true;
+
+    std::uint64_t comment = 0;
+    std::uint64_t quoted = 0;
+    if (masks.quote != 0 || in_quote != 0)
+    {
+        mask_quotes(data, comment, quoted);
+    }
+    else
+    {
+        // comment covers everything from '#' up to newline
+        if (in_comment)
+        {
+            if (masks.newline == 0)
+            {
+                comment = ~std::uint64_t(0);
+            }
+            else
+            {
+                comment = (masks.newline & (~masks.newline + 1)) - 1;
+                in_comment = false;
+            }
+        }
+        std::uint64_t hashes = masks.comment & ~comment;
+        while (hashes != 0)
+        {
+            std::uint64_t first = hashes & (~hashes + 1);
+            std::uint64_t after = masks.newline & ~(first | (first - 1));
+            if (after == 0)
+            {
+                comment |= ~(first - 1);
+                in_comment = true;
+            }
+            else
+            {
+                comment |= (after & (~after + 1)) - first;
+            }
+            hashes &= ~comment;
+        }
+    }
+
+    std::uint64_t token = ~(masks.newline | (masks.delimiter & ~quoted) | comment);
+    std::uint64_t shifted = (token << 1) | previous_token;
+    starts = token & ~shifted;
+    ends = ~token & shifted;
+    newlines = masks.newline;
+    previous_token = token >> 63;
+    return true;
+}
+
+// Quotes are rare, so blocks holding one are walked byte by byte. Text from a quote to the
+// matching unescaped quote is quoted, '#' in it does not start a comment and newline ends both
+void Line_Scanner::mask_quotes(const char *data, std::uint64_t &comment, std::uint64_t &quoted)
+{
+    for (std::size_t i = 0; i < SCAN_BLOCK_SIZE; i++)
+    {
+        char c = data[i];
+        std::uint64_t bit = std::uint64_t(1) << i;
+        if (c == '\n')
+        {
+            in_comment = false;
+            in_quote = 0;
+            escaped = false;
+        }
+        else if (in_comment)
+        {
+            comment |= bit;
+        }
+        else if (in_quote != 0)
+        {
+            quoted |= bit;
+            if (escaped)
+                escaped = false;
+            else if (c == '\\')
+                escaped = true;
+            else if (c == in_quote)
+                in_quote = 0;
+        }
+        else if (c == '#')
+        {
+            comment |= bit;
+            in_comment = true;
+        }
+        else if (c == '\'' || c == '"')
+        {
+            quoted |= bit;
+            in_quote = c;
+        }
+    }
+}
+
+bool Line_Scanner::next_line(std::vector<std::string_view> &tokens)
+{
+    tokens.clear();
+    for (;;)
+    {
+        std::uint64_t events = starts | ends | newlines;
+        if (events == 0)
+        {
+            if (load_block())
+                continue;
+
+            // text does not end with newline
+            if (previous_token)
+            {
+                tokens.push_back(text.substr(token_start));
+                previous_token = 0;
+            }
+            if (line_start >= text.length())
+                return false;
+            line_start = text.length();
+            return true;
+        }
+
+        std::uint64_t bit = events & (~events + 1);
+        std::size_t position = block + __builtin_ctzll(events);
+        if (ends & bit)
+        {
+            tokens.push_back(text.substr(token_start, position - token_start));
+            ends &= ~bit;
+        }
+        if (starts & bit)
+        {
+            token_start = position;
+            starts &= ~bit;
+        }
+        if (newlines & bit)
+        {
+            newlines &= ~bit;
+            line_start = position + 1;
+            return true;
+        }
+    }
+}
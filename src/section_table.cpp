@@ -1,13 +1,11 @@
 #include "../inc/section_table.hpp"
+#include "../inc/scanner.hpp"
 #include <map>
 #include <sstream>
 
 Section_Table::Section_Table()
 {
-    Section abs_sec = section("absolute", 0, 0);
-    Section und_sec = section("und", 0, 0);
-    table.insert(std::pair<std::string, Section>("und", und_sec));
-    table.insert(std::pair<std::string, Section>("absolute", abs_sec));
+    insertSection("und", 0, 0);
 }
 
 Section_Table::~Section_Table()
@@ -17,7 +15,7 @@ Section_Table::~Section_Table()
 std::string Section_Table::to_lower(std::string s)
 {
     // Transform to lower case
-    transform(s.begin(), s.end(), s.begin(), ::tolower);
+    fold_lower(s.data(), s.size(), &s[0]);
     // Remove ':' for labels
     if (std::string::npos != s.find(":"))
         return s.substr(0, s.length() - 1);
@@ -25,35 +23,78 @@ std::string Section_Table::to_lower(std::string s)
         return s;
 }
 
-bool Section_Table::insertSection(std::string name, unsigned int size, unsigned int offset)
+unsigned int Section_Table::insertSection(std::string name, unsigned int size, unsigned int offset)
 {
-    Section sec = section(to_lower(name), size, offset);
-
-    auto ret = table.insert(std::pair<std::string, Section>(to_lower(name), sec));
-    return ret.second;
+    name = to_lower(name);
+    auto ret = table.insert(std::pair<std::string, unsigned int>(name, sections.size()));
+    if (ret.second)
+        sections.push_back(section(name, size, offset));
+    // index of new or already existing section
+    return ret.first->second;
 }
 
-bool Section_Table::updateSize(std::string section, unsigned int lc)
+bool Section_Table::updateSize(unsigned int section, unsigned int lc)
 {
-    if (table.find(section) != table.end())
+    if (section < sections.size())
     {
-        table.find(section)->second.size = lc;
+        sections[section].size = lc;
         return true;
     }
     else
         return false;
 }
 
+Section &Section_Table::get_section(unsigned int section)
+{
+    return sections[section];
+}
+
+unsigned int Section_Table::size()
+{
+    return sections.size();
+}
+
+void Section_Table::allocate_bytecode(const std::vector<unsigned int> &initialized)
+{
+    // Statements are written at their offsets, buffers are zero filled so .skip needs no writes.
+    // Zeros after last initialized byte are never stored, .skip at the end of section costs nothing
+    for (unsigned int i = 0; i < sections.size(); i++)
+    {
+        unsigned int length = i < initialized.size() ? initialized[i] : 0;
+        if (sections[i].bytecode.size() < length)
+            sections[i].bytecode.resize(length, 0);
+    }
+}
+
+std::string Section_Table::format_bytecode(const Section &sec)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    std::string text;
+    text.reserve(sec.bytecode.size() * 3);
+    for (std::size_t i = 0; i < sec.bytecode.size(); i++)
+    {
+        unsigned char byte = sec.bytecode[i];
+        text += digits[byte >> 4];
+        text += digits[byte & 0xF];
+        // 16 bytes per line
+        text += (i % 16 == 15 || i + 1 == sec.bytecode.size()) ? '\n' : ' ';
+    }
+    return text;
+}
+
 std::string Section_Table::write_section_table()
 {
-    std::map<std::string, Section>::iterator it = table.begin();
+    std::map<std::string, unsigned int>::iterator it = table.begin();
     std::stringstream sstream;
     sstream << std::endl
             << "# Sections data" << std::endl;
     for (it = table.begin(); it != table.end(); ++it)
     {
-        sstream << "#" << it->first;
-        sstream << it->second.bytecode << std::endl;
+        const Section &sec = sections[it->second];
+        sstream << "#" << it->first << std::endl;
+        sstream << format_bytecode(sec);
+        if (sec.size > sec.bytecode.size())
+            sstream << "#zero fill " << sec.size - sec.bytecode.size() << std::endl;
     }
 
     return sstream.str();
@@ -61,40 +102,22 @@ std::string Section_Table::write_section_table()
 
 std::string Section_Table::debug_write_section_table()
 {
-    std::map<std::string, Section>::iterator it = table.begin();
+    std::map<std::string, unsigned int>::iterator it = table.begin();
     std::cout << " === SECTION TABLE === " << std::endl;
     for (it = table.begin(); it != table.end(); ++it)
     {
+        const Section &sec = sections[it->second];
         std::cout << "------------------------------" << std::endl;
-        std::cout << "Section name: " << it->first << ", size:  " << it->second.size << std::endl; //<< ", LC offset: " << it->second.offset << '\n';
-        std::cout << "Bytecode: " << it->second.bytecode << std::endl;
+        std::cout << "Section name: " << it->first << ", size:  " << sec.size << std::endl;
+        std::cout << "Bytecode: " << std::endl
+                  << format_bytecode(sec);
     }
 
     return "";
 }
 
-unsigned int Section_Table::insert_into_absolute_section(std::string literal)
-{
-    std::map<std::string, Section>::iterator it = table.find("absolute");
-    unsigned int ret_value = it->second.size;
-    it->second.size = it->second.size + literal.size();
-    // transformin literal from ABCD to AB CD
-    literal.insert(2, " ");
-    it->second.bytecode = it->second.bytecode.append("\n" + literal);
-    return ret_value;
-}
-
-void Section_Table::add_zeros_to_section(std::string section, unsigned int number_of_bytes)
+const std::string &Section_Table::section_name(unsigned int section)
 {
-    table.find(section)->second.bytecode = table.find(section)->second.bytecode.append("\n");
-    for (int i = 0; i < number_of_bytes; i++)
-    {
-        table.find(section)->second.bytecode = table.find(section)->second.bytecode.append("00 ");
-    }
+    static const std::string absolute = "absolute";
+    return section == ABSOLUTE ? absolute : sections[section].name;
 }
-
-void Section_Table::append_bytecode(std::string section, std::string bytes)
-{
-    std::map<std::string, Section>::iterator it = table.find(section);
-    it->second.bytecode = it->second.bytecode.append("\n" + bytes);
-}
\ No newline at end of file
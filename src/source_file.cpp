@@ -0,0 +1,95 @@
+#include "../inc/source_file.hpp"
+#include <fstream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+Source_File::Source_File()
+{
+    data = NULL;
+    length = 0;
+    mapping = NULL;
+    opened = false;
+}
+
+Source_File::~Source_File()
+{
+    close();
+}
+
+bool Source_File::open(std::string name)
+{
+    close();
+    int fd = ::open(name.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        opened = true;
+        // Empty file can not be mapped, it is just empty source
+        if (st.st_size == 0)
+        {
+            ::close(fd);
+            return true;
+        }
+
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            ::close(fd);
+            mapping = map;
+            data = static_cast<const char *>(map);
+            length = st.st_size;
+            return true;
+        }
+    }
+    ::close(fd);
+
+    std::ifstream input(name, std::ios::in | std::ios::binary);
+    if (!input.is_open())
+    {
+        opened = false;
+        return false;
+    }
+    std::stringstream contents;
+    contents << input.rdbuf();
+    buffer = contents.str();
+    data = buffer.data();
+    length = buffer.size();
+    opened = true;
+    return true;
+}
+
+bool Source_File::open(const char *data, std::size_t length)
+{
+    close();
+    this->data = data;
+    this->length = length;
+    opened = true;
+    return true;
+}
+
+void Source_File::close()
+{
+    if (mapping != NULL)
+        munmap(mapping, length);
+    mapping = NULL;
+    data = NULL;
+    length = 0;
+    opened = false;
+    buffer.clear();
+}
+
+bool Source_File::is_open()
+{
+    return opened;
+}
+
+std::string_view Source_File::text()
+{
+    return std::string_view(data, length);
+}
@@ -0,0 +1,135 @@
+#include "../inc/stats.hpp"
+#include "../inc/scanner.hpp"
+#include <sstream>
+#include <iomanip>
+
+thread_local unsigned long long heap_allocations = 0;
+
+static const unsigned int instruction_sizes[4] = {1, 2, 3, 5};
+
+void Assembler_stats::add(const Assembler_stats &other)
+{
+    for (unsigned int i = 0; i < PHASE_COUNT; i++)
+        phase_time[i] += other.phase_time[i];
+    for (unsigned int i = 0; i < 4; i++)
+        instructions[i] += other.instructions[i];
+    input_bytes += other.input_bytes;
+    lines += other.lines;
+    tokens += other.tokens;
+    directives += other.directives;
+    symbols += other.symbols;
+    relocations += other.relocations;
+    section_bytes += other.section_bytes;
+    heap_allocations += other.heap_allocations;
+}
+
+void Assembler_stats::count_instruction(unsigned int size)
+{
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        if (instruction_sizes[i] == size)
+            instructions[i]++;
+    }
+}
+
+Phase_Timer::Phase_Timer(Assembler_stats &stats, Stats_phase phase) : stats(stats)
+{
+    this->phase = phase;
+    start = Stats_clock::now();
+}
+
+Phase_Timer::~Phase_Timer()
+{
+    stats.phase_time[phase] += std::chrono::duration<double>(Stats_clock::now() - start).count();
+}
+
+const char *phase_name(Stats_phase phase)
+{
+    switch (phase)
+    {
+    case PHASE_READ:
+        return "read";
+    case PHASE_FIRST_PASS:
+        return "first_pass";
+    case PHASE_SECOND_PASS:
+        return "second_pass";
+    case PHASE_VERIFY:
+        return "verify";
+    case PHASE_WRITE_SYMBOLS:
+        return "write_symbol_table";
+    case PHASE_WRITE_SECTIONS:
+        return "write_section_table";
+    case PHASE_WRITE_RELOCATIONS:
+        return "write_relocation_table";
+    case PHASE_WRITE_OBJECT:
+        return "write_object_file";
+    default:
+        return "unknown";
+    }
+}
+
+std::string write_stats_text(std::string source, const Assembler_stats &stats)
+{
+    std::stringstream out;
+    out << "Stats for " << source << std::endl;
+    out << std::fixed << std::setprecision(3);
+    for (unsigned int i = 0; i < PHASE_COUNT; i++)
+    {
+        out << "  " << std::left << std::setw(24) << phase_name((Stats_phase)i)
+            << std::right << std::setw(10) << stats.phase_time[i] * 1000 << " ms" << std::endl;
+    }
+    out << "  scan kernel       " << scan_kernel_name(active_scan_kernel()) << std::endl;
+    out << "  input bytes       " << stats.input_bytes << std::endl;
+    out << "  lines             " << stats.lines << std::endl;
+    out << "  tokens            " << stats.tokens << std::endl;
+    out << "  instructions      ";
+    for (unsigned int i = 0; i < 4; i++)
+        out << instruction_sizes[i] << "B: " << stats.instructions[i] << (i < 3 ? "  " : "");
+    out << std::endl;
+    out << "  directives        " << stats.directives << std::endl;
+    out << "  symbols           " << stats.symbols << std::endl;
+    out << "  relocations       " << stats.relocations << std::endl;
+    out << "  section bytes     " << stats.section_bytes << std::endl;
+    out << "  heap allocations  " << stats.heap_allocations << std::endl;
+    return out.str();
+}
+
+static std::string json_string(std::string s)
+{
+    std::stringstream out;
+    out << '"';
+    for (std::string::iterator it = s.begin(); it != s.end(); ++it)
+    {
+        unsigned char c = *it;
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (unsigned int)c << std::dec << std::setfill(' ');
+        else
+            out << c;
+    }
+    out << '"';
+    return out.str();
+}
+
+std::string write_stats_json(std::string source, const Assembler_stats &stats)
+{
+    std::stringstream out;
+    out << std::setprecision(9);
+    out << "{\"source\": " << json_string(source) << ", \"time\": {";
+    for (unsigned int i = 0; i < PHASE_COUNT; i++)
+        out << (i ? ", " : "") << '"' << phase_name((Stats_phase)i) << "\": " << stats.phase_time[i];
+    out << "}, \"scan_kernel\": \"" << scan_kernel_name(active_scan_kernel())
+        << "\", \"input_bytes\": " << stats.input_bytes
+        << ", \"lines\": " << stats.lines
+        << ", \"tokens\": " << stats.tokens
+        << ", \"instructions\": {";
+    for (unsigned int i = 0; i < 4; i++)
+        out << (i ? ", " : "") << '"' << instruction_sizes[i] << "\": " << stats.instructions[i];
+    out << "}, \"directives\": " << stats.directives
+        << ", \"symbols\": " << stats.symbols
+        << ", \"relocations\": " << stats.relocations
+        << ", \"section_bytes\": " << stats.section_bytes
+        << ", \"heap_allocations\": " << stats.heap_allocations << "}";
+    return out.str();
+}
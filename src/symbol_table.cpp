@@ -1,7 +1,9 @@
 #include "../inc/symbol_table.hpp"
 #include <sstream>
+#include "../inc/lexer.hpp"
+#include "../inc/scanner.hpp"
 
-Symbol_Table::Symbol_Table()
+Symbol_Table::Symbol_Table() : slots(64, EMPTY_SLOT)
 {
 }
 
@@ -9,78 +11,119 @@ Symbol_Table::~Symbol_Table()
 {
 }
 
-std::string to_lower(std::string s)
+// Same hash and comparison as other tables keyed by names in source, see lexer.hpp
+unsigned int Symbol_Table::find_slot(std::string_view name, std::size_t h)
 {
-    // Transform to lower case
-    transform(s.begin(), s.end(), s.begin(), ::tolower);
-    // Remove ':' for labels
-    if (std::string::npos != s.find(":"))
-        return s.substr(0, s.length() - 1);
-    else
-        return s;
+    unsigned int mask = slots.size() - 1;
+    unsigned int slot = h & mask;
+    // stops on matching name or on empty slot where name can be inserted
+    while (slots[slot] != EMPTY_SLOT && !equal_ignore_case(symbols[slots[slot]].name, name))
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+void Symbol_Table::grow()
+{
+    std::vector<unsigned int> old_slots(slots.size() * 2, EMPTY_SLOT);
+    old_slots.swap(slots);
+    unsigned int mask = slots.size() - 1;
+    for (std::vector<unsigned int>::iterator it = old_slots.begin(); it != old_slots.end(); ++it)
+    {
+        if (*it == EMPTY_SLOT)
+            continue;
+        unsigned int slot = Name_hash()(symbols[*it].name) & mask;
+        while (slots[slot] != EMPTY_SLOT)
+            slot = (slot + 1) & mask;
+        slots[slot] = *it;
+    }
 }
 
-bool Symbol_Table::insertSymbol(std::string name, bool local,
-                                std::string section, unsigned int offset)
+bool Symbol_Table::insertSymbol(std::string_view name, bool local,
+                                unsigned int section, unsigned int offset)
 {
+    // keep load factor under 1/2
+    if (2 * (symbols.size() + 1) > slots.size())
+        grow();
+
+    unsigned int slot = find_slot(name, Name_hash()(name));
+    if (slots[slot] != EMPTY_SLOT)
+        return false;
+
+    std::string interned(name.size(), '\0');
+    fold_lower(name.data(), name.size(), &interned[0]);
+    names.push_back(interned);
+
     unsigned int id = global_id++;
-    Symbol smb = symbol(to_lower(name), local, id, section, offset);
+    symbols.push_back(symbol(names.back(), local, id, section, offset));
+    slots[slot] = id;
+    return true;
+}
 
-    auto ret = table.insert(std::pair<std::string, Symbol>(to_lower(name), smb));
-    return ret.second;
+Symbol_handle Symbol_Table::find_symbol(std::string_view name)
+{
+    Symbol_handle handle;
+    unsigned int slot = find_slot(name, Name_hash()(name));
+    if (slots[slot] == EMPTY_SLOT)
+    {
+        handle.id = EMPTY_SLOT;
+        handle.record = NULL;
+    }
+    else
+    {
+        handle.id = slots[slot];
+        handle.record = &symbols[handle.id];
+    }
+    return handle;
 }
 
-std::string Symbol_Table::write_symbol_table()
+Symbol &Symbol_Table::get_symbol(unsigned int id)
 {
-    std::map<std::string, Symbol>::iterator it = table.begin();
+    return symbols[id];
+}
+
+unsigned int Symbol_Table::size()
+{
+    return symbols.size();
+}
+
+std::vector<unsigned int> Symbol_Table::sorted_by_name()
+{
+    // Output is ordered by name, table itself is not
+    std::vector<unsigned int> order(symbols.size());
+    for (unsigned int i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b)
+              { return symbols[a].name < symbols[b].name; });
+    return order;
+}
+
+std::string Symbol_Table::write_symbol_table(Section_Table &section_table)
+{
+    std::vector<unsigned int> order = sorted_by_name();
     std::stringstream sstream;
 
     sstream << "#Symbol Table" << std::endl;
     sstream << "#Symbol name | ID | LC offset | isLocal | section" << std::endl;
     sstream << "#-------------------------------------------------" << std::endl;
-    for (it = table.begin(); it != table.end(); ++it)
+    for (std::vector<unsigned int>::iterator it = order.begin(); it != order.end(); ++it)
     {
-        sstream << it->first << "    | " << it->second.id << " |   " << it->second.offset << "   |   " << it->second.local << "   | " << it->second.section << std::endl;
+        const Symbol &smb = symbols[*it];
+        sstream << smb.name << "    | " << smb.id << " |   " << smb.offset << "   |   " << smb.local << "   | " << section_table.section_name(smb.section) << std::endl;
     }
     return sstream.str();
 }
 
-std::string Symbol_Table::debug_write_symbol_table()
+std::string Symbol_Table::debug_write_symbol_table(Section_Table &section_table)
 {
-    std::map<std::string, Symbol>::iterator it = table.begin();
+    std::vector<unsigned int> order = sorted_by_name();
     std::cout << " === SYMBOL TABLE === " << std::endl;
     std::cout << " Symbol name | ID | LC offset | isLocal | section" << std::endl;
     std::cout << "-------------------------------------------------" << std::endl;
-    for (it = table.begin(); it != table.end(); ++it)
+    for (std::vector<unsigned int>::iterator it = order.begin(); it != order.end(); ++it)
     {
-        std::cout << it->first << "    | " << it->second.id << " |   " << it->second.offset << "   |   " << it->second.local << "   | " << it->second.section << std::endl;
+        const Symbol &smb = symbols[*it];
+        std::cout << smb.name << "    | " << smb.id << " |   " << smb.offset << "   |   " << smb.local << "   | " << section_table.section_name(smb.section) << std::endl;
     }
 
     return "";
 }
-
-bool Symbol_Table::symbol_exists(std::string symbol_name)
-{
-    if (table.find(symbol_name) != table.end())
-    {
-        return true;
-    }
-    else
-        return false;
-}
-
-unsigned int Symbol_Table::get_symbol_id(std::string symbol_name)
-{
-    return (table.find(symbol_name))->second.id;
-}
-
-unsigned int Symbol_Table::get_symbol_offset(std::string symbol_name)
-{
-    return (table.find(symbol_name))->second.offset;
-}
-
-void Symbol_Table::update_symbol_to_global(std::string symbol_name)
-{
-    std::map<std::string, Symbol>::iterator it = table.find(symbol_name);
-    it->second.local = false;
-}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "../inc/thread_pool.hpp"
+#include <algorithm>
+
+Thread_Pool::Thread_Pool(unsigned int workers) : queues(workers == 0 ? 1 : workers)
+{
+    this->workers = workers == 0 ? 1 : workers;
+}
+
+Thread_Pool::~Thread_Pool()
+{
+}
+
+unsigned int Thread_Pool::size()
+{
+    return workers;
+}
+
+void Thread_Pool::run(std::vector<std::function<void()>> &tasks)
+{
+    // Deal tasks round robin
+    for (unsigned int i = 0; i < tasks.size(); i++)
+    {
+        Worker_queue &queue = queues[i % workers];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(i);
+    }
+
+    // Calling thread is worker 0
+    std::vector<std::thread> threads;
+    unsigned int active = std::min<std::size_t>(workers, tasks.size());
+    for (unsigned int w = 1; w < active; w++)
+        threads.push_back(std::thread(&Thread_Pool::work, this, w, std::ref(tasks)));
+    work(0, tasks);
+
+    for (std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it)
+        it->join();
+}
+
+void Thread_Pool::work(unsigned int worker, std::vector<std::function<void()>> &tasks)
+{
+    unsigned int task;
+    while (pop_task(worker, task) || steal_task(worker, task))
+        tasks[task]();
+}
+
+bool Thread_Pool::pop_task(unsigned int worker, unsigned int &task)
+{
+    Worker_queue &queue = queues[worker];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks.empty())
+        return false;
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool Thread_Pool::steal_task(unsigned int worker, unsigned int &task)
+{
+    for (unsigned int i = 1; i < workers; i++)
+    {
+        Worker_queue &victim = queues[(worker + i) % workers];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,14 @@
+# Forward references that single pass patches later, object has to match two pass
+.section text
+start:
+   ldr r1, $fwd
+   ldr r2, $fwd + 2
+   ldr r3, $3 + fwd - 1
+   ldr r4, later + 4
+   jmp later
+   jeq later - 2
+   str r1, fwd
+later:
+   halt
+.equ fwd, 6
+.end
@@ -0,0 +1,8 @@
+# Forward references under operators other than + and -, only two pass can encode them
+.section text
+   ldr r1, $fwd << 1
+   ldr r2, $fwd * 2
+   ldr r3, $10 - fwd
+   halt
+.equ fwd, 6
+.end
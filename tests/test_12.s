@@ -0,0 +1,11 @@
+# Character literals holding comment and delimiter characters
+.section text
+   ldr r0, $'#'   # comment after a literal
+   ldr r1, $','
+   ldr r2, $'\''
+   ldr r3, $' ' + '+'
+   halt
+.section data
+   .word '#', ',', '\\'   # it's a comment
+   .byte ',', '#'
+.end
@@ -0,0 +1,7 @@
+# Sections for an overlap the linker has to catch: empty b sits between a and c
+.section a
+   .skip 256
+.section b
+.section c
+   .word 1
+.end
@@ -0,0 +1,28 @@
+# file expressions.s
+.extern handler
+.equ base, 0xFF00
+.equ term_out, base + 0
+.equ term_in, base + 2
+.equ mask, ~(1 << 3) & 0xFF
+.section data
+table:
+    .word 1, 2 * 3, 'A' | 0x20, -1
+    .word handler + 4, start
+table_end:
+.equ words, (table_end - table) / 2
+    .skip 16 - words * 2
+.equ last, table_end - 2
+.section text
+start:
+    ldr r0, $mask ^ 0x0F
+    ldr r1, [r2 + words * 2]
+    ldr r1, [r2 - 2]
+    str r0, term_out
+    ldr r3, %last
+    ldr r4, %loop + 5
+    jmp handler + 2
+loop:
+    jeq %loop
+    call table + 2
+    ldr r0, $table_end - table
+.end
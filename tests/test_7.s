@@ -0,0 +1,26 @@
+# Bulk data directives
+.equ header_size, 6
+.extern printf
+.global greeting, table
+
+.section text
+start:
+   ldr r0, $greeting
+   push r0
+   call printf
+   halt
+
+.section rodata
+greeting: .asciz "Hello, world!\n", "#not a comment"
+path: .ascii "tests/test_7.bin"
+path_end:
+quote: .ascii "say \"hi\"\t\x41\\", ""   # escapes, empty string
+.byte path_end - path, -1, 0x7F, 'A', header_size << 2
+
+.section data
+table: .byte 1, 2, 3, end - table
+header: .incbin "tests/test_7.bin", 0, header_size
+payload: .incbin "tests/test_7.bin", header_size
+end: .word end - header
+.skip 4
+.end
@@ -0,0 +1,133 @@
+# file: isa.s
+# Runs every instruction group and prints one letter per passed check, '!' on failure
+.global start
+.section ivt
+   .word start
+   .word error
+   .skip 4
+   .word software
+   .skip 6
+
+.section text
+.equ term_out, 0xFF00
+start:
+   ldr r0, $6
+   ldr r1, $7
+   mul r0, r1
+   ldr r1, $42
+   call check
+   ldr r0, $42
+   ldr r1, $5
+   div r0, r1
+   sub r0, r1
+   ldr r1, $3
+   call check
+   ldr r0, $0x0F0F
+   ldr r1, $0x00FF
+   and r0, r1
+   ldr r1, $0x00F0
+   or r0, r1
+   ldr r1, $0x0F0F
+   xor r0, r1
+   not r0
+   ldr r1, $0xF00F
+   call check
+   ldr r0, $1
+   ldr r1, $4
+   shl r0, r1
+   ldr r1, $2
+   shr r0, r1
+   ldr r1, $4
+   call check
+# stack and exchange
+   ldr r0, $5
+   ldr r1, $9
+   push r0
+   push r1
+   pop r0
+   pop r1
+   xchg r0, r1
+   call check_swapped
+# memory operands
+   ldr r2, $table
+   ldr r0, [r2 + 2]
+   ldr r1, %value
+   call check
+   ldr r0, $0x1234
+   str r0, [r2 + 6]
+   ldr r1, table + 6
+   call check
+# signed compare, jumps through register and memory
+   ldr r0, $-1
+   ldr r1, $1
+   cmp r1, r0
+   jgt greater
+   jmp fail
+greater:
+   ldr r4, $through_register
+   jmp *r4
+   jmp fail
+through_register:
+   jmp *[r2 + 4]
+   jmp fail
+through_memory:
+   ldr r0, $0x00F0
+   ldr r1, $0x0F00
+   test r0, r1
+   jeq %bits_clear
+   jmp fail
+bits_clear:
+# pc as a register
+   ldr r4, $pc_written
+   ldr pc, r4
+   jmp fail
+pc_written:
+   ldr r0, pc
+here:
+   ldr r1, $here
+   call check
+# software interrupt
+   ldr r0, $4
+   int r0
+   ldr r0, r5
+   ldr r1, $0x55
+   call check
+   ldr r0, $'\n'
+   str r0, term_out
+   halt
+
+check_swapped:
+   ldr r3, $5
+   cmp r0, r3
+   jne fail
+   ldr r0, r1
+   ldr r1, $9
+check:
+   cmp r0, r1
+   jne fail
+   ldr r3, letter
+   str r3, term_out
+   ldr r0, $1
+   add r3, r0
+   str r3, letter
+   ret
+
+fail:
+   ldr r0, $'!'
+   str r0, term_out
+   halt
+
+error:
+   ldr r0, $'?'
+   str r0, term_out
+   halt
+
+software:
+   ldr r5, $0x55
+   iret
+
+.section data
+letter: .word 'A'
+table: .word 0x1111, 0x2222, through_memory, 0
+value: .word 0x2222
+.end
@@ -0,0 +1,156 @@
+# file: loops.s
+# Hot loops for the translated code path, prints one letter per passed check, '!' on failure
+.global start
+.section ivt
+   .word start
+   .word error
+   .skip 12
+
+.section text
+.equ term_out, 0xFF00
+.equ count, 300
+start:
+# sum of 1..1000 in a loop that touches only registers
+   ldr r0, $0
+   ldr r1, $0
+   ldr r2, $1
+   ldr r3, $1000
+sum:
+   add r1, r2
+   add r0, r1
+   cmp r1, r3
+   jne sum
+   ldr r1, $41748
+   call check
+# array filled and summed through memory, pointer in a register
+   ldr r2, $array
+   ldr r1, $0
+fill:
+   str r1, [r2]
+   ldr r0, $2
+   add r2, r0
+   ldr r0, $1
+   add r1, r0
+   ldr r0, $count
+   cmp r1, r0
+   jne fill
+   ldr r2, $array
+   ldr r1, $0
+   ldr r4, $0
+total:
+   ldr r0, [r2 + 0]
+   add r4, r0
+   ldr r0, $2
+   add r2, r0
+   ldr r0, $1
+   add r1, r0
+   ldr r0, $count
+   cmp r1, r0
+   jne total
+   ldr r0, r4
+   ldr r1, $44850
+   call check
+# calls, stack and signed compare on a count going below zero
+   ldr r4, $0
+   ldr r1, $20
+squares:
+   push r1
+   call square
+   pop r1
+   add r4, r0
+   ldr r0, $1
+   sub r1, r0
+   ldr r0, $-20
+   cmp r1, r0
+   jgt squares
+   ldr r0, r4
+   ldr r1, $5340
+   call check
+# test and exchange in a loop counting set bits
+   ldr r1, $1
+   ldr r3, $0
+   ldr r4, $0
+   ldr r5, $128
+word:
+   ldr r0, $0xB6D5
+bits:
+   test r0, r1
+   jeq clear
+   ldr r2, $1
+   add r3, r2
+clear:
+   ldr r2, $1
+   shr r0, r2
+   add r4, r2
+   cmp r4, r5
+   jeq counted
+   ldr r2, $15
+   and r2, r4
+   test r2, r2
+   jeq word
+   jmp bits
+counted:
+   xchg r0, r3
+   ldr r1, $80
+   call check
+# terminal output from a hot loop
+   ldr r0, $'0'
+   ldr r1, $'9'
+   ldr r2, $1
+digits:
+   str r0, term_out
+   add r0, r2
+   cmp r1, r0
+   jgt digits
+   str r0, term_out
+   ldr r0, $' '
+   str r0, term_out
+# loop that rewrites the immediate of one of its own instructions
+   ldr r4, $0
+   ldr r1, $0
+   ldr r2, $1
+   ldr r3, $40
+rewrite:
+   str r1, patched + 3
+patched:
+   ldr r0, $0
+   add r4, r0
+   add r1, r2
+   cmp r1, r3
+   jne rewrite
+   ldr r0, r4
+   ldr r1, $780
+   call check
+   ldr r0, $'\n'
+   str r0, term_out
+   halt
+
+square:
+   ldr r0, r1
+   mul r0, r1
+   ret
+
+check:
+   cmp r0, r1
+   jne fail
+   ldr r3, letter
+   str r3, term_out
+   ldr r0, $1
+   add r3, r0
+   str r3, letter
+   ret
+
+fail:
+   ldr r0, $'!'
+   str r0, term_out
+   halt
+
+error:
+   ldr r0, $'?'
+   str r0, term_out
+   halt
+
+.section data
+letter: .word 'A'
+array: .skip 600
+.end
@@ -0,0 +1,90 @@
+/* Assembles through the C interface of libasenzt: output has to match the object written by
+ * asembler, errors have to come back as diagnostics, and many snippets are timed */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../inc/asenzt.h"
+
+static char *read_file(const char *name, size_t *length)
+{
+    FILE *file = fopen(name, "rb");
+    char *data;
+    long size;
+    if (file == NULL)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = malloc(size > 0 ? size : 1);
+    *length = fread(data, 1, size, file);
+    fclose(file);
+    return data;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *snippet = ".section text\n   ldr r0, $5\n   add r0, r1\n   jeq done\ndone:\n   halt\n.end\n";
+    const char *broken = ".section text\n   ldr r0, $5\n   jmp nowhere\n.end\n";
+    size_t source_length, expected_length, object_length;
+    char *source, *expected;
+    const unsigned char *object;
+    asenzt_options options;
+    asenzt_result *result;
+    struct timespec start, end;
+    double seconds;
+    int i, count = 10000;
+
+    if (argc != 3)
+    {
+        printf("Usage: test_library input_file.s expected_object.o\n");
+        return 1;
+    }
+    source = read_file(argv[1], &source_length);
+    expected = read_file(argv[2], &expected_length);
+    if (source == NULL || expected == NULL)
+    {
+        printf("Input file error\n");
+        return 1;
+    }
+
+    asenzt_default_options(&options);
+    options.verify = 1;
+    result = asenzt_assemble(source, source_length, &options);
+    object = asenzt_object(result, &object_length);
+    if (!asenzt_success(result) || object_length != expected_length || memcmp(object, expected, object_length) != 0)
+    {
+        printf("Object of %s differs from %s\n%s", argv[1], argv[2], asenzt_diagnostics(result));
+        return 1;
+    }
+    asenzt_free(result);
+
+    result = asenzt_assemble(broken, strlen(broken), NULL);
+    if (asenzt_success(result) || strlen(asenzt_diagnostics(result)) == 0)
+    {
+        printf("Error in source was not reported\n");
+        return 1;
+    }
+    printf("%s", asenzt_diagnostics(result));
+    asenzt_free(result);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++)
+    {
+        result = asenzt_assemble(snippet, strlen(snippet), NULL);
+        if (!asenzt_success(result))
+        {
+            printf("Snippet failed\n%s", asenzt_diagnostics(result));
+            return 1;
+        }
+        asenzt_free(result);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Assembled %d snippets, %.1f us per snippet\n", count, seconds / count * 1e6);
+
+    free(source);
+    free(expected);
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Scans sources with every scan kernel the cpu supports, token streams have to match the
+// scalar kernel. Edge cases put quotes, comments and escapes across block boundaries
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../inc/scanner.hpp"
+
+typedef std::vector<std::vector<std::string_view>> Token_stream;
+
+static Token_stream scan(std::string_view text)
+{
+    Token_stream lines;
+    std::vector<std::string_view> tokens;
+    Line_Scanner scanner(text);
+    while (scanner.next_line(tokens))
+        lines.push_back(tokens);
+    return lines;
+}
+
+static bool compare_kernels(const std::string &name, std::string_view text)
+{
+    use_scan_kernel(SCAN_SCALAR);
+    Token_stream expected = scan(text);
+
+    const Scan_kernel kernels[] = {SCAN_SSE2, SCAN_AVX2};
+    for (Scan_kernel kernel : kernels)
+    {
+        if (!use_scan_kernel(kernel))
+            continue;
+        Token_stream actual = scan(text);
+        if (actual != expected)
+        {
+            std::size_t line = 0;
+            while (line < actual.size() && line < expected.size() && actual[line] == expected[line])
+                line++;
+            std::cout << name << ": " << scan_kernel_name(kernel) << " kernel differs from scalar at line "
+                      << line + 1 << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string edge_cases()
+{
+    std::stringstream out;
+    // Quote opened near the end of a block and closed in the next one
+    out << std::string(60, ' ') << "ldr r0, $'#' # comment's quote\n";
+    out << std::string(62, ' ') << "'\\'' , ','\n";
+    out << ".asciz \"a, b # c\", \"it's\"   # trailing\n";
+    out << "   .word '\\\\', '#'\r\n";
+    // Comment running over a whole block
+    out << "#" << std::string(130, 'x') << "\n";
+    // Unterminated quote ends at newline
+    out << "ldr r1, $'" << std::string(70, ',') << "\n";
+    out << "halt";
+    return out.str();
+}
+
+int main(int argc, char *argv[])
+{
+    bool no_errors = compare_kernels("edge cases", edge_cases());
+
+    // Edge case has to come out as these tokens, whichever kernel is used
+    Token_stream tokens = scan(edge_cases());
+    if (tokens.size() != 7 || tokens[0].size() != 3 || tokens[0][2] != "$'#'" || tokens[1].size() != 2 ||
+        tokens[1][1] != "','" || tokens[3].size() != 3 || tokens[3][2] != "'#'" || !tokens[4].empty())
+    {
+        std::cout << "edge cases: tokens split at quoted characters" << std::endl;
+        no_errors = false;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::ifstream file(argv[i], std::ios::binary);
+        if (!file)
+        {
+            std::cout << "Input file error " << argv[i] << std::endl;
+            return 1;
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+        std::string source = text.str();
+        no_errors = compare_kernels(argv[i], source) && no_errors;
+    }
+
+    std::cout << "Scan kernels compared:";
+    const Scan_kernel kernels[] = {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2};
+    for (Scan_kernel kernel : kernels)
+    {
+        if (use_scan_kernel(kernel))
+            std::cout << " " << scan_kernel_name(kernel);
+    }
+    std::cout << std::endl;
+    return no_errors ? 0 : 1;
+}